@@ -1,4 +1,12 @@
 #include <bits/stdc++.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
 using namespace std;
 
 // Forward declarations
@@ -9,6 +17,15 @@ class UserManager;
 class MessageRouter;
 class PersistenceManager;
 
+// Where a logged-in user's messages go when it is connected over the network. Bound to
+// the User at login and released at logout.
+class Session
+{
+public:
+    virtual void deliver(const Message &message) = 0;
+    virtual ~Session() = default;
+};
+
 // User class representing a user of the chat server
 class User
 {
@@ -17,7 +34,8 @@ private:
     std::string username;
     std::string password;
     std::vector<std::string> contactList;
-    bool onlineStatus;
+    std::atomic<bool> onlineStatus;
+    std::shared_ptr<Session> session; // read with atomic_load: any thread may route to this user
 
 public:
     User(const std::string &userID, const std::string &username, const std::string &password)
@@ -67,6 +85,16 @@ public:
         return onlineStatus;
     }
 
+    void setSession(std::shared_ptr<Session> newSession)
+    {
+        std::atomic_store(&session, std::move(newSession));
+    }
+
+    std::shared_ptr<Session> getSession() const
+    {
+        return std::atomic_load(&session);
+    }
+
     void sendMessage(const std::string &receiverID, const std::string &content);
     void receiveMessage(const Message &message);
 };
@@ -107,27 +135,259 @@ public:
     }
 };
 
+enum class Presence
+{
+    ONLINE,
+    OFFLINE
+};
+
+struct PresenceEvent
+{
+    std::string userID;
+    Presence presence;
+    uint64_t sequence; // increases with each change to the same user; listeners may see events out of order
+};
+
+using PresenceListener = std::function<void(const PresenceEvent &)>;
+
+// Where paging through online users left off. Users online for the whole walk are seen
+// exactly once; users logging in or out during it may or may not be.
+struct OnlineUserCursor
+{
+    size_t shard = 0;
+    std::optional<std::string> after; // last user ID returned from `shard`; empty at its start
+    bool done = false;
+};
+
+// UserManager class for managing user-related operations. Users are striped over shards
+// by user ID, each with its own lock, so reactor threads logging different users in and
+// out rarely contend.
+class UserManager
+{
+private:
+    struct Shard
+    {
+        std::unordered_map<std::string, User *> users;
+        std::map<std::string, User *> onlineUsers; // ordered, so a page can resume after an ID
+        uint64_t sequence = 0;
+        mutable std::mutex shardMutex;
+    };
+
+    std::vector<Shard> shards;
+    std::shared_ptr<const std::vector<PresenceListener>> presenceListeners = std::make_shared<const std::vector<PresenceListener>>();
+    std::mutex listenersMutex; // serialises listener registration only
+
+    Shard &shardFor(const std::string &userID)
+    {
+        return shards[std::hash<std::string>()(userID) % shards.size()];
+    }
+
+    const Shard &shardFor(const std::string &userID) const
+    {
+        return shards[std::hash<std::string>()(userID) % shards.size()];
+    }
+
+    // Called outside the shard lock, so listeners may call back into the manager
+    void publishPresence(const PresenceEvent &event)
+    {
+        for (const PresenceListener &listener : *std::atomic_load(&presenceListeners))
+            listener(event);
+    }
+
+public:
+    explicit UserManager(size_t shardCount = 64) : shards(std::max<size_t>(1, shardCount)) {}
+
+    void registerUser(const std::string &userID, const std::string &username, const std::string &password)
+    {
+        User *user = new User(userID, username, password);
+        Shard &shard = shardFor(userID);
+        std::lock_guard<std::mutex> lock(shard.shardMutex);
+        shard.users[userID] = user;
+        // Save user data using PersistenceManager
+    }
+
+    // A session passed here replaces any session the user was bound to
+    User *loginUser(const std::string &userID, const std::string &password, std::shared_ptr<Session> session = nullptr)
+    {
+        Shard &shard = shardFor(userID);
+        PresenceEvent event{userID, Presence::ONLINE, 0};
+        User *user;
+        {
+            std::lock_guard<std::mutex> lock(shard.shardMutex);
+            auto it = shard.users.find(userID);
+            if (it == shard.users.end() || !it->second->authenticate(password))
+                return nullptr;
+            user = it->second;
+            user->setSession(std::move(session));
+            if (user->isOnline())
+                return user;
+            user->setOnlineStatus(true);
+            shard.onlineUsers[userID] = user;
+            event.sequence = ++shard.sequence;
+        }
+        publishPresence(event);
+        return user;
+    }
+
+    // With `session`, only logs out if the user is still bound to that session, so a
+    // connection closing does not log out a newer login from elsewhere
+    void logoutUser(User *user, const Session *session = nullptr)
+    {
+        Shard &shard = shardFor(user->getUserID());
+        PresenceEvent event{user->getUserID(), Presence::OFFLINE, 0};
+        {
+            std::lock_guard<std::mutex> lock(shard.shardMutex);
+            if ((session && user->getSession().get() != session) || !user->isOnline())
+                return;
+            user->setOnlineStatus(false);
+            user->setSession(nullptr);
+            shard.onlineUsers.erase(event.userID);
+            event.sequence = ++shard.sequence;
+        }
+        publishPresence(event);
+    }
+
+    User *getUserByID(const std::string &userID) const
+    {
+        const Shard &shard = shardFor(userID);
+        std::lock_guard<std::mutex> lock(shard.shardMutex);
+        auto it = shard.users.find(userID);
+        return it == shard.users.end() ? nullptr : it->second;
+    }
+
+    // Up to `limit` online users from where `cursor` left off, advancing it. Holds one
+    // shard's lock at a time, only while copying that page's users out. A limit of zero
+    // is read as one, so a `while (!cursor.done)` loop always makes progress.
+    std::vector<User *> getOnlineUsersPage(OnlineUserCursor &cursor, size_t limit) const
+    {
+        limit = std::max<size_t>(limit, 1);
+        std::vector<User *> page;
+        while (!cursor.done && page.size() < limit)
+        {
+            {
+                const Shard &shard = shards[cursor.shard];
+                std::lock_guard<std::mutex> lock(shard.shardMutex);
+                auto it = !cursor.after ? shard.onlineUsers.begin() : shard.onlineUsers.upper_bound(*cursor.after);
+                for (; it != shard.onlineUsers.end() && page.size() < limit; ++it)
+                {
+                    page.push_back(it->second);
+                    cursor.after = it->first;
+                }
+                if (it != shard.onlineUsers.end())
+                    break;
+            }
+            cursor.after.reset();
+            cursor.done = ++cursor.shard == shards.size();
+        }
+        return page;
+    }
+
+    // Visits every online user without copying them all out first
+    template <typename Visitor>
+    void forEachOnlineUser(Visitor visit) const
+    {
+        OnlineUserCursor cursor;
+        while (!cursor.done)
+            for (User *user : getOnlineUsersPage(cursor, 256))
+                visit(user);
+    }
+
+    // Copies the whole online set; prefer the paged API on a large server
+    std::vector<User *> getOnlineUsers() const
+    {
+        std::vector<User *> onlineUserList;
+        forEachOnlineUser([&](User *user)
+                          { onlineUserList.push_back(user); });
+        return onlineUserList;
+    }
+
+    // Listeners run on the thread that logged the user in or out
+    void addPresenceListener(PresenceListener listener)
+    {
+        std::lock_guard<std::mutex> lock(listenersMutex);
+        auto listeners = std::make_shared<std::vector<PresenceListener>>(*presenceListeners);
+        listeners->push_back(std::move(listener));
+        std::atomic_store(&presenceListeners, std::shared_ptr<const std::vector<PresenceListener>>(std::move(listeners)));
+    }
+};
+
+// MessageRouter class for routing messages between users
+class MessageRouter
+{
+private:
+    UserManager *userManager;
+
+public:
+    MessageRouter(UserManager *userManager) : userManager(userManager) {}
+
+    void routeMessage(User *sender, const std::string &receiverID, const std::string &content)
+    {
+        User *receiver = userManager->getUserByID(receiverID);
+        if (receiver)
+        {
+            Message message(sender->getUserID(), receiverID, content);
+            receiver->receiveMessage(message);
+            // Save message using PersistenceManager
+        }
+    }
+};
+
+// PersistenceManager class for managing data persistence
+class PersistenceManager
+{
+public:
+    void saveUser(User *user)
+    {
+        // Save user data to a persistent storage
+    }
+
+    User *loadUser(const std::string &userID)
+    {
+        // Load user data from a persistent storage and create a User object
+        return nullptr;
+    }
+
+    void saveMessage(const Message &message)
+    {
+        // Save message data to a persistent storage
+    }
+
+    Message loadMessage(const std::string &messageID)
+    {
+        // Load message data from a persistent storage and create a Message object
+        return Message("", "", "");
+    }
+};
+
 // ChatServer class representing the central chat server component
 class ChatServer
 {
 private:
-    std::unordered_map<std::string, User *> users;
     UserManager *userManager;
     MessageRouter *messageRouter;
     PersistenceManager *persistenceManager;
 
-public:
     ChatServer()
     {
         userManager = new UserManager();
-        messageRouter = new MessageRouter();
+        messageRouter = new MessageRouter(userManager);
         persistenceManager = new PersistenceManager();
     }
 
+public:
+    static ChatServer *getInstance()
+    {
+        static ChatServer instance;
+        return &instance;
+    }
+
+    ChatServer(const ChatServer &) = delete;
+    ChatServer &operator=(const ChatServer &) = delete;
+
     ~ChatServer()
     {
-        delete userManager;
         delete messageRouter;
+        delete userManager;
         delete persistenceManager;
     }
 
@@ -136,14 +396,14 @@ public:
         userManager->registerUser(userID, username, password);
     }
 
-    User *loginUser(const std::string &userID, const std::string &password)
+    User *loginUser(const std::string &userID, const std::string &password, std::shared_ptr<Session> session = nullptr)
     {
-        return userManager->loginUser(userID, password);
+        return userManager->loginUser(userID, password, std::move(session));
     }
 
-    void logoutUser(User *user)
+    void logoutUser(User *user, const Session *session = nullptr)
     {
-        userManager->logoutUser(user);
+        userManager->logoutUser(user, session);
     }
 
     void sendMessage(User *sender, const std::string &receiverID, const std::string &content)
@@ -155,99 +415,878 @@ public:
     {
         return userManager->getOnlineUsers();
     }
+
+    std::vector<User *> getOnlineUsersPage(OnlineUserCursor &cursor, size_t limit) const
+    {
+        return userManager->getOnlineUsersPage(cursor, limit);
+    }
+
+    void addPresenceListener(PresenceListener listener)
+    {
+        userManager->addPresenceListener(std::move(listener));
+    }
 };
 
-// UserManager class for managing user-related operations
-class UserManager
+/*
+Wire protocol
+-------------
+Every frame is a 4-byte big-endian length, then that many bytes: a 1-byte frame type
+followed by the frame's string fields, each as a 4-byte big-endian length and the bytes.
+
+    client -> server   LOGIN(userID, password)   SEND(receiverID, content)   LOGOUT()
+    server -> client   LOGIN_OK()   LOGIN_FAILED()   DELIVER(senderID, content)
+*/
+enum class FrameType : uint8_t
+{
+    LOGIN = 1,
+    LOGIN_OK,
+    LOGIN_FAILED,
+    SEND,
+    DELIVER,
+    LOGOUT
+};
+
+static constexpr uint32_t MAX_FRAME_SIZE = 1 << 20;
+
+static void appendUint32(std::string &out, uint32_t value)
+{
+    char bytes[4] = {(char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value};
+    out.append(bytes, 4);
+}
+
+static uint32_t readUint32(const char *data)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static void appendFrame(std::string &out, FrameType type, std::initializer_list<std::string_view> fields)
+{
+    size_t size = 1;
+    for (std::string_view field : fields)
+        size += 4 + field.size();
+    appendUint32(out, (uint32_t)size);
+    out.push_back((char)type);
+    for (std::string_view field : fields)
+    {
+        appendUint32(out, (uint32_t)field.size());
+        out.append(field.data(), field.size());
+    }
+}
+
+struct Frame
+{
+    FrameType type;
+    std::vector<std::string_view> fields; // point into the FrameReader's buffer
+};
+
+// Reassembles frames from whatever chunks the socket delivers. A frame's fields stay
+// valid until the next call to append().
+class FrameReader
 {
 private:
-    std::unordered_map<std::string, User *> users;
-    std::unordered_map<std::string, User *> onlineUsers;
+    std::string buffer;
+    size_t offset = 0;
+    bool malformed = false;
 
 public:
-    void registerUser(const std::string &userID, const std::string &username, const std::string &password)
+    void append(const char *data, size_t size)
     {
-        User *user = new User(userID, username, password);
-        users[userID] = user;
-        // Save user data using PersistenceManager
+        if (offset > 0 && offset * 2 >= buffer.size())
+        {
+            buffer.erase(0, offset);
+            offset = 0;
+        }
+        buffer.append(data, size);
     }
 
-    User *loginUser(const std::string &userID, const std::string &password)
+    // False once no complete frame is buffered, or if the peer sent garbage
+    bool next(Frame &frame)
     {
-        auto it = users.find(userID);
-        if (it != users.end())
+        if (malformed || buffer.size() - offset < 4)
+            return false;
+        uint32_t size = readUint32(buffer.data() + offset);
+        if (size == 0 || size > MAX_FRAME_SIZE)
         {
-            User *user = it->second;
-            if (user->authenticate(password))
+            malformed = true;
+            return false;
+        }
+        if (buffer.size() - offset - 4 < size)
+            return false;
+        const char *data = buffer.data() + offset + 4;
+        frame.type = (FrameType)data[0];
+        frame.fields.clear();
+        for (size_t position = 1; position < size;)
+        {
+            uint32_t length = size - position >= 4 ? readUint32(data + position) : UINT32_MAX;
+            if (length > size - position - 4)
             {
-                user->setOnlineStatus(true);
-                onlineUsers[userID] = user;
-                return user;
+                malformed = true;
+                return false;
             }
+            frame.fields.emplace_back(data + position + 4, length);
+            position += 4 + length;
         }
-        return nullptr;
+        offset += 4 + size;
+        return true;
     }
 
-    void logoutUser(User *user)
+    bool isMalformed() const { return malformed; }
+};
+
+// Frames posted to a reactor from other threads, drained on its wakeFd. Sessions share it
+// with the reactor, so a session still reachable after the reactor stopped finds it
+// closed and drops the frame instead of touching the freed reactor.
+struct ReactorInbox
+{
+    struct Delivery
     {
-        user->setOnlineStatus(false);
-        onlineUsers.erase(user->getUserID());
+        int fd;
+        uint64_t connectionID;
+        std::string frame;
+    };
+
+    std::vector<Delivery> deliveries;
+    int wakeFd;
+    bool closed = false; // set once the reactor stops; wakeFd may be closed after that
+    std::mutex inboxMutex;
+};
+
+// Delivers a user's messages to the connection it logged in on. The connection belongs to
+// one reactor, so delivery from any other thread is posted to that reactor.
+class ConnectionSession : public Session
+{
+private:
+    std::shared_ptr<ReactorInbox> inbox;
+    int fd;
+    uint64_t connectionID;
+
+public:
+    ConnectionSession(std::shared_ptr<ReactorInbox> inbox, int fd, uint64_t connectionID)
+        : inbox(std::move(inbox)), fd(fd), connectionID(connectionID) {}
+
+    void deliver(const Message &message) override;
+};
+
+// One thread and one epoll instance serving its share of the connections. Each reactor
+// has its own SO_REUSEPORT listening socket, so the kernel spreads new connections across
+// reactors and they never share a connection or a lock on the I/O path.
+class Reactor
+{
+private:
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+    static constexpr size_t MAX_PENDING_OUTPUT = 16 << 20; // a client this far behind is dropped
+
+    struct Connection
+    {
+        int fd;
+        uint64_t id;
+        FrameReader reader;
+        std::string output;
+        size_t outputOffset = 0;
+        bool dirty = false;        // has output to flush at the end of this loop iteration
+        bool waitingWrite = false; // registered for EPOLLOUT
+        bool overflowed = false;   // closed at the next flush
+        User *user = nullptr;
+        std::shared_ptr<ConnectionSession> session;
+    };
+
+    ChatServer *chatServer;
+    int epollFd;
+    int listenFd;
+    int wakeFd;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::vector<int> dirtyConnections;
+    uint64_t nextConnectionID = 1;
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> connectionCount{0};
+
+    std::shared_ptr<ReactorInbox> inbox = std::make_shared<ReactorInbox>();
+    std::thread thread;
+
+    static Reactor *&current()
+    {
+        static thread_local Reactor *reactor = nullptr;
+        return reactor;
     }
 
-    std::vector<User *> getOnlineUsers() const
+    Connection *find(int fd, uint64_t connectionID)
     {
-        std::vector<User *> onlineUserList;
-        for (const auto &pair : onlineUsers)
+        auto it = connections.find(fd);
+        return it == connections.end() || it->second->id != connectionID ? nullptr : it->second.get();
+    }
+
+    void watch(Connection &connection, bool writable)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (writable ? (uint32_t)EPOLLOUT : 0u);
+        event.data.fd = connection.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.waitingWrite = writable;
+    }
+
+    // Never closes the connection itself, so callers may keep using it
+    void queueOutput(Connection &connection, const std::string &frame)
+    {
+        if (connection.output.size() - connection.outputOffset + frame.size() > MAX_PENDING_OUTPUT)
+            connection.overflowed = true;
+        else
+            connection.output += frame;
+        if (!connection.dirty)
         {
-            onlineUserList.push_back(pair.second);
+            connection.dirty = true;
+            dirtyConnections.push_back(connection.fd);
+        }
+    }
+
+    // Returns false if the connection was closed
+    bool flush(Connection &connection)
+    {
+        if (connection.overflowed)
+        {
+            closeConnection(connection);
+            return false;
+        }
+        while (connection.outputOffset < connection.output.size())
+        {
+            ssize_t written = send(connection.fd, connection.output.data() + connection.outputOffset,
+                                   connection.output.size() - connection.outputOffset, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN)
+                    break;
+                closeConnection(connection);
+                return false;
+            }
+            connection.outputOffset += written;
+        }
+        if (connection.outputOffset == connection.output.size())
+        {
+            connection.output.clear();
+            connection.outputOffset = 0;
+        }
+        bool pending = !connection.output.empty();
+        if (pending != connection.waitingWrite)
+            watch(connection, pending);
+        return true;
+    }
+
+    void closeConnection(Connection &connection)
+    {
+        if (connection.user)
+            chatServer->logoutUser(connection.user, connection.session.get());
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+        connectionCount--;
+        connections.erase(connection.fd); // destroys `connection`
+    }
+
+    void acceptConnections()
+    {
+        while (true)
+        {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return; // EAGAIN, or out of descriptors until some close
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            auto connection = std::make_unique<Connection>();
+            connection->fd = fd;
+            connection->id = nextConnectionID++;
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            connections[fd] = std::move(connection);
+            connectionCount++;
+        }
+    }
+
+    // Returns false if the connection was closed
+    bool handleFrame(Connection &connection, const Frame &frame)
+    {
+        std::string reply;
+        switch (frame.type)
+        {
+        case FrameType::LOGIN:
+        {
+            if (frame.fields.size() != 2 || connection.user)
+                return false;
+            auto session = std::make_shared<ConnectionSession>(inbox, connection.fd, connection.id);
+            connection.user = chatServer->loginUser(std::string(frame.fields[0]), std::string(frame.fields[1]), session);
+            if (connection.user)
+                connection.session = session;
+            appendFrame(reply, connection.user ? FrameType::LOGIN_OK : FrameType::LOGIN_FAILED, {});
+            queueOutput(connection, reply);
+            return true;
+        }
+        case FrameType::SEND:
+            if (frame.fields.size() != 2 || !connection.user)
+                return false;
+            chatServer->sendMessage(connection.user, std::string(frame.fields[0]), std::string(frame.fields[1]));
+            return true;
+        case FrameType::LOGOUT:
+            if (connection.user)
+                chatServer->logoutUser(connection.user, connection.session.get());
+            connection.user = nullptr;
+            connection.session.reset();
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void handleReadable(Connection &connection)
+    {
+        char chunk[READ_CHUNK];
+        while (true)
+        {
+            ssize_t received = recv(connection.fd, chunk, sizeof(chunk), 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received < 0 && errno == EAGAIN)
+                return;
+            if (received <= 0)
+            {
+                closeConnection(connection);
+                return;
+            }
+            connection.reader.append(chunk, received);
+            Frame frame;
+            int fd = connection.fd;
+            while (connection.reader.next(frame))
+            {
+                if (!handleFrame(connection, frame))
+                {
+                    if (connections.count(fd))
+                        closeConnection(connection);
+                    return;
+                }
+            }
+            if (connection.reader.isMalformed())
+            {
+                closeConnection(connection);
+                return;
+            }
+            if ((size_t)received < sizeof(chunk))
+                return;
+        }
+    }
+
+    void drainInbox()
+    {
+        uint64_t wakeups;
+        ssize_t ignored = read(wakeFd, &wakeups, sizeof(wakeups));
+        (void)ignored;
+        std::vector<ReactorInbox::Delivery> deliveries;
+        {
+            std::lock_guard<std::mutex> lock(inbox->inboxMutex);
+            deliveries.swap(inbox->deliveries);
+        }
+        for (const ReactorInbox::Delivery &delivery : deliveries)
+            if (Connection *connection = find(delivery.fd, delivery.connectionID))
+                queueOutput(*connection, delivery.frame);
+    }
+
+    void run()
+    {
+        current() = this;
+        std::vector<epoll_event> events(1024);
+        while (!stopping)
+        {
+            int ready = epoll_wait(epollFd, events.data(), (int)events.size(), -1);
+            for (int i = 0; i < ready; i++)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listenFd)
+                {
+                    acceptConnections();
+                    continue;
+                }
+                if (fd == wakeFd)
+                {
+                    drainInbox();
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end())
+                    continue;
+                Connection &connection = *it->second;
+                if (events[i].events & EPOLLOUT && !flush(connection))
+                    continue;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    handleReadable(connection);
+            }
+            // One write per connection per iteration, however many frames it was sent
+            for (int fd : dirtyConnections)
+            {
+                auto it = connections.find(fd);
+                if (it != connections.end() && it->second->dirty)
+                {
+                    it->second->dirty = false;
+                    flush(*it->second);
+                }
+            }
+            dirtyConnections.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(inbox->inboxMutex);
+            inbox->closed = true;
+            inbox->deliveries.clear();
+        }
+        // Users still bound to these connections go offline, so nothing routes to them
+        for (auto &entry : connections)
+        {
+            Connection &connection = *entry.second;
+            if (connection.user)
+                chatServer->logoutUser(connection.user, connection.session.get());
+            close(entry.first);
+        }
+        connections.clear();
+        current() = nullptr;
+    }
+
+public:
+    // `port` 0 picks a free port; further reactors pass the first one's port
+    Reactor(ChatServer *chatServer, uint16_t port) : chatServer(chatServer)
+    {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (bind(listenFd, (sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, SOMAXCONN) < 0)
+            throw std::runtime_error(std::string("cannot listen: ") + strerror(errno));
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        inbox->wakeFd = wakeFd;
+        for (int fd : {listenFd, wakeFd})
+        {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+        thread = std::thread(&Reactor::run, this);
+    }
+
+    ~Reactor()
+    {
+        stop();
+        close(listenFd);
+        close(wakeFd);
+        close(epollFd);
+    }
+
+    uint16_t getPort() const
+    {
+        sockaddr_in address{};
+        socklen_t length = sizeof(address);
+        getsockname(listenFd, (sockaddr *)&address, &length);
+        return ntohs(address.sin_port);
+    }
+
+    size_t getConnectionCount() const { return connectionCount; }
+
+    // Logs out the users bound to this reactor's connections and closes them. Frames
+    // posted afterwards are dropped.
+    void stop()
+    {
+        if (!thread.joinable())
+            return;
+        stopping = true;
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+        thread.join();
+    }
+
+    // Sends a frame on one of this reactor's connections, from any thread. Dropped if
+    // the connection has closed since.
+    void post(int fd, uint64_t connectionID, std::string frame)
+    {
+        post(*inbox, fd, connectionID, std::move(frame));
+    }
+
+    // Same, addressed by the reactor's inbox, which stays valid after the reactor is gone
+    static void post(ReactorInbox &target, int fd, uint64_t connectionID, std::string frame)
+    {
+        Reactor *reactor = current();
+        if (reactor && reactor->inbox.get() == &target)
+        {
+            if (Connection *connection = reactor->find(fd, connectionID))
+                reactor->queueOutput(*connection, frame);
+            return;
+        }
+        // The wakeup is written under the lock, so it cannot race with the reactor
+        // closing wakeFd after marking the inbox closed
+        std::lock_guard<std::mutex> lock(target.inboxMutex);
+        if (target.closed)
+            return;
+        bool wasEmpty = target.deliveries.empty();
+        target.deliveries.push_back({fd, connectionID, std::move(frame)});
+        if (wasEmpty)
+        {
+            uint64_t one = 1;
+            ssize_t ignored = write(target.wakeFd, &one, sizeof(one));
+            (void)ignored;
         }
-        return onlineUserList;
     }
 };
 
-// MessageRouter class for routing messages between users
-class MessageRouter
+void ConnectionSession::deliver(const Message &message)
+{
+    std::string frame;
+    appendFrame(frame, FrameType::DELIVER, {message.getSenderID(), message.getContent()});
+    Reactor::post(*inbox, fd, connectionID, std::move(frame));
+}
+
+// TCP front end for the ChatServer: one reactor per core, all on the same port
+class ChatNetworkServer
 {
+private:
+    std::vector<std::unique_ptr<Reactor>> reactors;
+
 public:
-    void routeMessage(User *sender, const std::string &receiverID, const std::string &content)
+    ChatNetworkServer(ChatServer *chatServer, uint16_t port = 0, size_t reactorCount = std::thread::hardware_concurrency())
     {
-        User *receiver = userManager->getUserByID(receiverID);
-        if (receiver)
+        for (size_t i = 0; i < std::max<size_t>(1, reactorCount); i++)
         {
-            Message message(sender->getUserID(), receiverID, content);
-            receiver->receiveMessage(message);
-            // Save message using PersistenceManager
+            reactors.push_back(std::make_unique<Reactor>(chatServer, port));
+            port = reactors.front()->getPort();
         }
     }
+
+    uint16_t getPort() const { return reactors.front()->getPort(); }
+
+    size_t getConnectionCount() const
+    {
+        size_t count = 0;
+        for (const auto &reactor : reactors)
+            count += reactor->getConnectionCount();
+        return count;
+    }
+
+    void stop()
+    {
+        for (auto &reactor : reactors)
+            reactor->stop();
+    }
 };
 
-// PersistenceManager class for managing data persistence
-class PersistenceManager
+// Opens `idle` connections that log in and then sit there, plus `active` connections in
+// pairs that message each other as fast as the server allows, each keeping `window`
+// messages in flight. Latency is measured from just before SEND is written to when the
+// DELIVER arrives. Users "idle<i>" and "load<i>" must be registered with password "pw".
+class LoadGenerator
 {
-public:
-    void saveUser(User *user)
+private:
+    struct Client
     {
-        // Save user data to a persistent storage
+        int fd = -1;
+        FrameReader reader;
+        std::string output;
+        size_t outputOffset = 0;
+        bool waitingWrite = true;
+        bool loggedIn = false;
+        size_t index = 0;
+    };
+
+    uint16_t port;
+    int epollFd;
+    std::vector<Client> clients;
+    size_t loggedIn = 0;
+    size_t failed = 0;
+
+    static uint64_t nowNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
     }
 
-    User *loadUser(const std::string &userID)
+    void flush(Client &client)
     {
-        // Load user data from a persistent storage and create a User object
-        return nullptr;
+        while (client.outputOffset < client.output.size())
+        {
+            ssize_t written = send(client.fd, client.output.data() + client.outputOffset,
+                                   client.output.size() - client.outputOffset, MSG_NOSIGNAL);
+            if (written <= 0)
+                break;
+            client.outputOffset += written;
+        }
+        if (client.outputOffset == client.output.size())
+        {
+            client.output.clear();
+            client.outputOffset = 0;
+        }
+        bool pending = !client.output.empty();
+        if (pending != client.waitingWrite)
+        {
+            epoll_event event{};
+            event.events = EPOLLIN | (pending ? (uint32_t)EPOLLOUT : 0u);
+            event.data.u64 = client.index;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &event);
+            client.waitingWrite = pending;
+        }
     }
 
-    void saveMessage(const Message &message)
+    // Loopback offers ~28k ephemeral ports per source address, so connections are spread
+    // over 127.0.0.2-127.0.0.17 to get past 100k
+    bool open(Client &client, const std::string &userID)
     {
-        // Save message data to a persistent storage
+        client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (client.fd < 0)
+            return false;
+        int one = 1;
+        setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(client.fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+        sockaddr_in source{};
+        source.sin_family = AF_INET;
+        source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + client.index % 16);
+        bind(client.fd, (sockaddr *)&source, sizeof(source));
+        sockaddr_in server{};
+        server.sin_family = AF_INET;
+        server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        server.sin_port = htons(port);
+        if (connect(client.fd, (sockaddr *)&server, sizeof(server)) < 0 && errno != EINPROGRESS)
+        {
+            close(client.fd);
+            client.fd = -1;
+            return false;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.u64 = client.index;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &event);
+        appendFrame(client.output, FrameType::LOGIN, {userID, "pw"});
+        return true;
     }
 
-    Message loadMessage(const std::string &messageID)
+    // Handles whatever is ready; onDeliver(client, content) sees each DELIVER
+    template <typename OnDeliver>
+    void poll(int timeoutMillis, OnDeliver onDeliver)
     {
-        // Load message data from a persistent storage and create a Message object
-        return Message("", "", "");
+        epoll_event events[1024];
+        int ready = epoll_wait(epollFd, events, 1024, timeoutMillis);
+        for (int i = 0; i < ready; i++)
+        {
+            Client &client = clients[events[i].data.u64];
+            if (events[i].events & EPOLLOUT)
+                flush(client);
+            if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                continue;
+            char chunk[64 * 1024];
+            ssize_t received = recv(client.fd, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                if (received == 0 || errno != EAGAIN)
+                {
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+                    failed += !client.loggedIn;
+                }
+                continue;
+            }
+            client.reader.append(chunk, received);
+            Frame frame;
+            while (client.reader.next(frame))
+            {
+                if (frame.type == FrameType::LOGIN_OK)
+                {
+                    client.loggedIn = true;
+                    loggedIn++;
+                }
+                else if (frame.type == FrameType::LOGIN_FAILED)
+                    failed++;
+                else if (frame.type == FrameType::DELIVER && frame.fields.size() == 2)
+                    onDeliver(client, frame.fields[1]);
+            }
+            if (!client.output.empty())
+                flush(client);
+        }
+    }
+
+public:
+    struct Result
+    {
+        size_t connected = 0;
+        double messagesPerSecond = 0;
+        double p50Micros = 0;
+        double p99Micros = 0;
+    };
+
+    explicit LoadGenerator(uint16_t port) : port(port), epollFd(epoll_create1(EPOLL_CLOEXEC)) {}
+
+    ~LoadGenerator()
+    {
+        for (Client &client : clients)
+            if (client.fd >= 0)
+                close(client.fd);
+        close(epollFd);
+    }
+
+    Result run(size_t idle, size_t active, size_t window, std::chrono::milliseconds duration)
+    {
+        active &= ~(size_t)1; // pairs
+        clients.resize(idle + active);
+        auto ignore = [](Client &, std::string_view) {};
+        // Connect and log in, keeping a bounded number of handshakes outstanding
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            clients[i].index = i;
+            while (i - loggedIn - failed >= 1000)
+                poll(100, ignore);
+            if (!open(clients[i], i < idle ? "idle" + std::to_string(i) : "load" + std::to_string(i - idle)))
+                failed++;
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (loggedIn + failed < clients.size() && std::chrono::steady_clock::now() < deadline)
+            poll(100, ignore);
+
+        Result result;
+        result.connected = loggedIn;
+        std::vector<uint32_t> latencies; // nanoseconds
+        bool measuring = true;
+        auto sendTo = [this](Client &client, size_t peer)
+        {
+            uint64_t sentAt = nowNanos();
+            appendFrame(client.output, FrameType::SEND, {"load" + std::to_string(peer), std::string_view((const char *)&sentAt, sizeof(sentAt))});
+        };
+        for (size_t i = idle; i < clients.size(); i++)
+        {
+            for (size_t m = 0; m < window; m++)
+                sendTo(clients[i], (i - idle) ^ 1);
+            flush(clients[i]);
+        }
+        auto onDeliver = [&](Client &client, std::string_view content)
+        {
+            uint64_t sentAt;
+            if (content.size() != sizeof(sentAt))
+                return;
+            memcpy(&sentAt, content.data(), sizeof(sentAt));
+            if (measuring)
+                latencies.push_back((uint32_t)std::min<uint64_t>(nowNanos() - sentAt, UINT32_MAX));
+            sendTo(client, (client.index - idle) ^ 1); // the reply keeps `window` in flight
+        };
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < duration)
+            poll(10, onDeliver);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        measuring = false;
+
+        result.messagesPerSecond = latencies.size() / seconds;
+        if (!latencies.empty())
+        {
+            std::sort(latencies.begin(), latencies.end());
+            result.p50Micros = latencies[latencies.size() / 2] / 1000.0;
+            result.p99Micros = latencies[latencies.size() * 99 / 100] / 1000.0;
+        }
+        return result;
     }
 };
 
+// Resident memory of this process, in MiB
+static double residentMiB()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.rfind("VmRSS:", 0) == 0)
+            return std::stod(line.substr(6)) / 1024;
+    return 0;
+}
+
+// Reactor-like threads log random users in and out while another thread pages through
+// the online set, once with a single lock and once striped. Presence events must add up
+// to the final online count.
+void benchmarkSessionRegistry()
+{
+    const int userCount = 100000, threads = 8, operationsPerThread = 100000;
+    for (size_t shardCount : {1, 64})
+    {
+        UserManager userManager(shardCount);
+        for (int i = 0; i < userCount; i++)
+            userManager.registerUser("user" + std::to_string(i), "User" + std::to_string(i), "pw");
+        std::vector<User *> users;
+        for (int i = 0; i < userCount; i++)
+            users.push_back(userManager.getUserByID("user" + std::to_string(i)));
+        std::atomic<long long> netOnline{0};
+        userManager.addPresenceListener([&netOnline](const PresenceEvent &event)
+                                        { netOnline += event.presence == Presence::ONLINE ? 1 : -1; });
+
+        std::atomic<bool> running{true};
+        std::atomic<long long> pagesRead{0};
+        std::thread pager([&]()
+                          {
+            while (running)
+            {
+                OnlineUserCursor cursor;
+                while (!cursor.done)
+                {
+                    userManager.getOnlineUsersPage(cursor, 100);
+                    pagesRead++;
+                }
+            } });
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++)
+            workers.emplace_back([&, t]()
+                                 {
+                std::mt19937 random(t);
+                for (int i = 0; i < operationsPerThread; i++)
+                {
+                    int index = random() % userCount;
+                    if (random() % 2)
+                        userManager.loginUser("user" + std::to_string(index), "pw");
+                    else
+                        userManager.logoutUser(users[index]);
+                } });
+        for (auto &worker : workers)
+            worker.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        running = false;
+        pager.join();
+
+        size_t online = userManager.getOnlineUsers().size();
+        std::cout << shardCount << (shardCount == 1 ? " shard:   " : " shards: ") << threads * operationsPerThread / seconds / 1e6
+                  << "M logins/logouts per second, " << pagesRead << " pages read alongside, " << online << " online"
+                  << (online == (size_t)netOnline ? "" : " (PRESENCE EVENTS DISAGREE)") << std::endl;
+    }
+}
+
+// Holds as many idle logged-in connections as the descriptor limit allows (up to 100k)
+// while pairs of active clients exchange messages, then reports throughput and latency
+void benchmarkNetworkServer(ChatServer &chatServer)
+{
+    const size_t active = 64, window = 8;
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    // Client and server ends both live in this process
+    size_t idle = std::min<size_t>(100000, (limit.rlim_cur - 256) / 2 - active);
+
+    for (size_t i = 0; i < idle; i++)
+        chatServer.registerUser("idle" + std::to_string(i), "Idle" + std::to_string(i), "pw");
+    for (size_t i = 0; i < active; i++)
+        chatServer.registerUser("load" + std::to_string(i), "Load" + std::to_string(i), "pw");
+
+    double baseline = residentMiB();
+    ChatNetworkServer server(&chatServer);
+    LoadGenerator generator(server.getPort());
+    LoadGenerator::Result result = generator.run(idle, active, window, std::chrono::seconds(3));
+    std::cout << result.connected << " connections logged in (" << idle << " idle"
+              << (idle < 100000 ? ", capped by RLIMIT_NOFILE " + std::to_string(limit.rlim_cur) : "") << "), server holds "
+              << server.getConnectionCount() << ", " << residentMiB() - baseline << " MiB for both ends" << std::endl;
+    std::cout << active << " active clients, " << window << " in flight each: " << result.messagesPerSecond
+              << " msgs/s, p50 " << result.p50Micros << " us, p99 " << result.p99Micros << " us" << std::endl;
+    server.stop();
+}
+
 // Implementation of User class methods
 void User::sendMessage(const std::string &receiverID, const std::string &content)
 {
@@ -256,14 +1295,24 @@ void User::sendMessage(const std::string &receiverID, const std::string &content
 
 void User::receiveMessage(const Message &message)
 {
+    if (std::shared_ptr<Session> bound = getSession())
+    {
+        bound->deliver(message);
+        return;
+    }
     std::cout << "Received message from " << message.getSenderID()
               << " at " << message.getTimestamp()
               << ": " << message.getContent() << std::endl;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    ChatServer chatServer;
+    ChatServer &chatServer = *ChatServer::getInstance();
+    std::atomic<bool> showPresence{true};
+    chatServer.addPresenceListener([&showPresence](const PresenceEvent &event)
+                                   {
+        if (showPresence)
+            std::cout << "User " << event.userID << (event.presence == Presence::ONLINE ? " is online" : " went offline") << std::endl; });
 
     // Register users
     chatServer.registerUser("1", "User1", "password1");
@@ -281,12 +1330,15 @@ int main()
         user1->sendMessage("2", "Hello, User2!");
         user2->sendMessage("1", "Hi, User1!");
 
-        // Get online users
-        std::vector<User *> onlineUsers = chatServer.getOnlineUsers();
+        // Get online users, a page at a time
         std::cout << "Online users: ";
-        for (const auto &user : onlineUsers)
+        OnlineUserCursor cursor;
+        while (!cursor.done)
         {
-            std::cout << user->getUsername() << " ";
+            for (User *user : chatServer.getOnlineUsersPage(cursor, 1))
+            {
+                std::cout << user->getUsername() << " ";
+            }
         }
         std::cout << std::endl;
 
@@ -296,5 +1348,11 @@ int main()
         std::cout << "Users logged out." << std::endl;
     }
 
+    showPresence = false;
+    benchmarkSessionRegistry();
+    // Raises RLIMIT_NOFILE and opens thousands of loopback sockets, so only on request
+    if (argc > 1 && std::string(argv[1]) == "--bench-network")
+        benchmarkNetworkServer(chatServer);
+
     return 0;
 }
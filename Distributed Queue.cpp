@@ -1,4 +1,11 @@
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 using namespace std;
 
 /*##########################################################################
@@ -8,7 +15,8 @@ Design an In-Memory Distributed Queue like Kafka.
 
 Core Use Cases
 --------------
-1. The queue should be in-memory and should not require access to the file system.
+1. The queue should be in-memory and should not require access to the file system. Topics can opt in
+   to persistence, which keeps their log in files and survives a restart.
 2. There can be multiple topics in the queue.
 3. A (string) message can be published on a topic by a producer/publisher and consumers/subscribers can subscribe to the topic to receive the messages.
 4. There can be multiple producers and consumers.
@@ -16,25 +24,727 @@ Core Use Cases
 6. A consumer can listen to multiple topics.
 7. The consumer should print "<consumer_id> received <message>" on receiving the message.
 8. The queue system should be multi-threaded, i.e., messages can be produced or consumed in parallel by different producers/consumers.
+9. Consumers belong to consumer groups. Every group reads the whole topic at its own offset, and can
+   rewind that offset to replay messages that are still retained.
+10. A topic is split into partitions. Messages with the same key go to the same partition and keep
+    their order; each partition is owned by exactly one member of a group, and ownership is
+    rebalanced whenever a consumer joins or leaves.
 
 ##########################################################################*/
 
+// Immutable bytes shared by every Message that views them. A log segment is one: its
+// arena is a slab that many payloads are carved from, and it is freed once the log has
+// dropped it and the last Message pointing into it is gone.
+class SharedBuffer
+{
+private:
+    std::atomic<int> references{1};
+
+public:
+    virtual ~SharedBuffer() = default;
+
+    void retain() { references.fetch_add(1, std::memory_order_relaxed); }
+
+    void release()
+    {
+        if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+};
+
+// A buffer holding a single payload, for messages built outside a log
+class OwnedBuffer : public SharedBuffer
+{
+private:
+    std::string bytes;
+
+public:
+    explicit OwnedBuffer(std::string bytes) : bytes(std::move(bytes)) {}
+
+    std::string_view view() const { return bytes; }
+};
+
+// A delivered record. Copying a Message shares its payload; the bytes are never copied.
+// The reference is on the whole buffer, so a Message read from the log keeps its entire
+// segment allocated until it is destroyed, even after retention has dropped the segment.
 class Message
 {
 private:
-    std::string content;
+    long long offset;
+    std::string_view content;
+    SharedBuffer *buffer;
+    int partition;
 
 public:
-    explicit Message(const std::string &content) : content(content) {}
+    // Views `content` inside `buffer`, taking a reference on it
+    Message(long long offset, std::string_view content, SharedBuffer *buffer, int partition)
+        : offset(offset), content(content), buffer(buffer), partition(partition)
+    {
+        buffer->retain();
+    }
+
+    Message(long long offset, std::string content, int partition = 0) : offset(offset), partition(partition)
+    {
+        OwnedBuffer *owned = new OwnedBuffer(std::move(content));
+        this->content = owned->view();
+        buffer = owned;
+    }
+
+    Message(const Message &other) : offset(other.offset), content(other.content), buffer(other.buffer), partition(other.partition)
+    {
+        buffer->retain();
+    }
+
+    Message(Message &&other) noexcept : offset(other.offset), content(other.content), buffer(other.buffer), partition(other.partition)
+    {
+        other.buffer = nullptr;
+    }
+
+    Message &operator=(Message other) noexcept
+    {
+        std::swap(offset, other.offset);
+        std::swap(content, other.content);
+        std::swap(buffer, other.buffer);
+        std::swap(partition, other.partition);
+        return *this;
+    }
 
-    std::string getContent() const { return content; }
+    ~Message()
+    {
+        if (buffer)
+            buffer->release();
+    }
+
+    long long getOffset() const { return offset; }
+
+    int getPartition() const { return partition; }
+
+    // Valid for as long as this Message (or a copy of it) is alive
+    std::string_view getContent() const { return content; }
 };
 
-class IProducer
+// Futex wait/wake on a 32-bit word, used to wake exactly as many consumers as needed
+static void futexWait(std::atomic<uint32_t> *word, uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout.count() / 1000000000;
+    ts.tv_nsec = timeout.count() % 1000000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t> *word, int count)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+// CRC-32 (IEEE) of a record, stored next to it in persistent segments. Slicing-by-8:
+// eight table lookups per 8-byte step instead of one per byte.
+static uint32_t crc32(std::string_view bytes)
+{
+    static const auto tables = []()
+    {
+        std::array<std::array<uint32_t, 256>, 8> entries{};
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            entries[0][i] = value;
+        }
+        for (int slice = 1; slice < 8; slice++)
+        {
+            for (uint32_t i = 0; i < 256; i++)
+                entries[slice][i] = (entries[slice - 1][i] >> 8) ^ entries[0][entries[slice - 1][i] & 0xFF];
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(bytes.data());
+    size_t size = bytes.size();
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24] ^
+              tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^ tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+    }
+    for (; size > 0; data++, size--)
+        crc = tables[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// A fixed-size chunk of a partition log: an arena and a table of record slots, both
+// allocated once. Producers claim a slot and arena space together with a single CAS
+// on `state`, copy their bytes, then mark the slot ready; no lock is taken.
+//
+// A persistent segment keeps the same layout in a memory-mapped file:
+//   [header page][slot table][arena]
+// so appends are plain memcpys into the page cache and sync() only has to fdatasync.
+// The slot table doubles as the segment's index, which is all recovery has to load.
+class LogSegment : public SharedBuffer
 {
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> ready{0};
+        uint32_t position = 0;
+        uint32_t length = 0;
+        uint32_t checksum = 0; // persistent segments only
+    };
+
+    struct FileHeader
+    {
+        uint64_t magic;
+        int64_t baseOffset;
+        uint64_t arenaBytes;
+        uint64_t maxRecords;
+        std::atomic<int64_t> durableEnd; // every record below it was on disk at the last sync
+    };
+
+    static constexpr uint64_t FILE_MAGIC = 0x4451534547303031ull; // "DQSEG001"
+    static constexpr size_t PAGE_BYTES = 4096;
+
+    // state = [sealed:1][slots used:23][arena bytes used:40]
+    static constexpr uint64_t SEALED = 1ull << 63;
+    static constexpr int SLOT_SHIFT = 40;
+    static constexpr uint64_t SLOT_MASK = (1ull << 23) - 1;
+    static constexpr uint64_t BYTES_MASK = (1ull << SLOT_SHIFT) - 1;
+
+    long long baseOffset;
+    char *arena; // left uninitialised in memory; every byte is written before it is read
+    size_t arenaBytes;
+    Slot *slots;
+    uint64_t slotCapacity;
+    std::atomic<uint64_t> state{0};
+    std::chrono::steady_clock::time_point createdAt;
+
+    std::unique_ptr<char[]> memoryArena;
+    std::unique_ptr<Slot[]> memorySlots;
+    std::string path; // empty for in-memory segments
+    int fd = -1;
+    char *mapping = nullptr;
+    size_t mappingBytes = 0;
+    FileHeader *header = nullptr;
+
+    static size_t slotTableBytes(size_t maxRecords)
+    {
+        return (maxRecords * sizeof(Slot) + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+    }
+
+    LogSegment(long long baseOffset, size_t capacity, size_t maxRecords, const std::string &path, int fd, char *mapping, size_t mappingBytes)
+        : baseOffset(baseOffset), arena(mapping + PAGE_BYTES + slotTableBytes(maxRecords)), arenaBytes(capacity),
+          slots(reinterpret_cast<Slot *>(mapping + PAGE_BYTES)), slotCapacity(std::min<uint64_t>(maxRecords, SLOT_MASK)),
+          createdAt(std::chrono::steady_clock::now()), path(path), fd(fd), mapping(mapping), mappingBytes(mappingBytes),
+          header(reinterpret_cast<FileHeader *>(mapping)) {}
+
+    // Maps `path`, creating it with `bytes` zeroed bytes first when `create` is set
+    static char *mapFile(const std::string &path, bool create, size_t &bytes, int &fd)
+    {
+        fd = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+        if (fd < 0)
+            throw std::runtime_error("cannot open segment file " + path);
+        struct stat info;
+        if (create ? ::ftruncate(fd, (off_t)bytes) != 0 : ::fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("cannot size segment file " + path);
+        }
+        if (!create)
+            bytes = (size_t)info.st_size;
+        void *mapped = bytes < PAGE_BYTES ? MAP_FAILED : ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("cannot map segment file " + path);
+        }
+        return static_cast<char *>(mapped);
+    }
+
 public:
-    virtual ~IProducer() = default;
-    virtual void produceMessage(ITopic *topic, Message *message) = 0;
+    LogSegment(long long baseOffset, size_t capacity, size_t maxRecords)
+        : baseOffset(baseOffset), arenaBytes(capacity), slotCapacity(std::min<uint64_t>(maxRecords, SLOT_MASK)),
+          createdAt(std::chrono::steady_clock::now()), memoryArena(new char[capacity]), memorySlots(new Slot[maxRecords])
+    {
+        arena = memoryArena.get();
+        slots = memorySlots.get();
+    }
+
+    ~LogSegment() override
+    {
+        if (mapping)
+        {
+            ::munmap(mapping, mappingBytes);
+            ::close(fd);
+        }
+    }
+
+    // A new, empty segment backed by the file at `path`
+    static LogSegment *create(const std::string &path, long long baseOffset, size_t capacity, size_t maxRecords)
+    {
+        int fd;
+        size_t bytes = PAGE_BYTES + slotTableBytes(maxRecords) + capacity;
+        char *mapping = mapFile(path, true, bytes, fd);
+        LogSegment *segment = new LogSegment(baseOffset, capacity, maxRecords, path, fd, mapping, bytes);
+        FileHeader *header = segment->header;
+        header->magic = FILE_MAGIC;
+        header->baseOffset = baseOffset;
+        header->arenaBytes = capacity;
+        header->maxRecords = maxRecords;
+        header->durableEnd.store(baseOffset);
+        return segment;
+    }
+
+    // Reopens a segment file after a restart. Records below the header's durable end are
+    // taken as they are; only the few appended after the last sync are checksummed, and
+    // the segment ends at the first one that is missing or torn. A durable end that does
+    // not fit the slot table or arena is not trusted: every record is checksummed instead.
+    // Returns nullptr for a file that is not a segment.
+    static LogSegment *recover(const std::string &path)
+    {
+        int fd;
+        size_t bytes = 0;
+        char *mapping = mapFile(path, false, bytes, fd);
+        const FileHeader *header = reinterpret_cast<const FileHeader *>(mapping);
+        if (header->magic != FILE_MAGIC || PAGE_BYTES + slotTableBytes(header->maxRecords) + header->arenaBytes != bytes)
+        {
+            ::munmap(mapping, bytes);
+            ::close(fd);
+            return nullptr;
+        }
+        LogSegment *segment = new LogSegment(header->baseOffset, header->arenaBytes, header->maxRecords, path, fd, mapping, bytes);
+        int64_t durable = header->durableEnd.load() - header->baseOffset;
+        uint64_t count = 0, used = 0;
+        if (durable > 0 && (uint64_t)durable <= segment->slotCapacity)
+        {
+            const Slot &last = segment->slots[durable - 1];
+            if ((uint64_t)last.position + last.length <= segment->arenaBytes)
+            {
+                count = (uint64_t)durable;
+                used = (uint64_t)last.position + last.length;
+            }
+        }
+        while (count < segment->slotCapacity)
+        {
+            Slot &slot = segment->slots[count];
+            if (!slot.ready.load() || slot.position != used || used + slot.length > segment->arenaBytes ||
+                crc32(std::string_view(segment->arena + slot.position, slot.length)) != slot.checksum)
+                break;
+            used += slot.length;
+            count++;
+        }
+        // Clear what a crashed producer left behind so reused slots start out not ready
+        for (uint64_t slot = count; slot < segment->slotCapacity && segment->slots[slot].ready.load(); slot++)
+            segment->slots[slot].ready.store(0);
+        segment->state.store((count << SLOT_SHIFT) | used);
+        return segment;
+    }
+
+    // Returns the record's offset, or -1 after sealing the segment if it does not fit
+    long long tryAppend(std::string_view content)
+    {
+        uint64_t current = state.load();
+        uint64_t slot, position;
+        do
+        {
+            if (current & SEALED)
+                return -1;
+            slot = (current >> SLOT_SHIFT) & SLOT_MASK;
+            position = current & BYTES_MASK;
+            if (slot == slotCapacity || position + content.size() > arenaBytes)
+            {
+                state.fetch_or(SEALED);
+                return -1;
+            }
+        } while (!state.compare_exchange_weak(current, ((slot + 1) << SLOT_SHIFT) | (position + content.size())));
+
+        memcpy(arena + position, content.data(), content.size());
+        slots[slot].position = (uint32_t)position;
+        slots[slot].length = (uint32_t)content.size();
+        if (header)
+            slots[slot].checksum = crc32(content);
+        slots[slot].ready.store(1, std::memory_order_release);
+        return baseOffset + (long long)slot;
+    }
+
+    // Stops further appends and returns the final end offset
+    long long seal()
+    {
+        uint64_t sealed = state.fetch_or(SEALED) | SEALED;
+        return baseOffset + (long long)((sealed >> SLOT_SHIFT) & SLOT_MASK);
+    }
+
+    // Offsets below getEndOffset() are claimed; read() waits for a claimed record
+    // whose producer is still copying it
+    std::string_view read(long long offset) const
+    {
+        const Slot &slot = slots[offset - baseOffset];
+        while (!slot.ready.load(std::memory_order_acquire))
+            std::this_thread::yield();
+        return std::string_view(arena + slot.position, slot.length);
+    }
+
+    bool isPersistent() const { return header != nullptr; }
+
+    // Makes every record below `end` durable: waits for producers still copying one,
+    // flushes the file, then advances the header's durable end. A sealed segment's
+    // final header is flushed too, so its recovery never has to verify checksums.
+    void sync(long long end)
+    {
+        if (header->durableEnd.load() == end)
+            return;
+        for (long long offset = header->durableEnd.load(); offset < end; offset++)
+            read(offset);
+        ::fdatasync(fd);
+        header->durableEnd.store(end);
+        if (isSealed() && end == getEndOffset())
+            ::fdatasync(fd);
+    }
+
+    long long getDurableEnd() const { return header ? header->durableEnd.load() : getEndOffset(); }
+
+    // Called when retention drops the segment; the mapping stays valid until release
+    void removeFile()
+    {
+        if (!path.empty())
+            ::unlink(path.c_str());
+    }
+
+    long long getBaseOffset() const { return baseOffset; }
+
+    long long getEndOffset() const { return baseOffset + (long long)((state.load() >> SLOT_SHIFT) & SLOT_MASK); }
+
+    bool isSealed() const { return state.load() & SEALED; }
+
+    size_t getCapacity() const { return arenaBytes; }
+
+    std::chrono::steady_clock::time_point getCreatedAt() const { return createdAt; }
+};
+
+// Minimal epoch-based reclamation for segments. Threads that touch segments without
+// the roll lock hold a Guard; a segment dropped by retention only loses the log's
+// reference once every guard that could still see it has been released. Messages
+// still viewing it keep it alive after that.
+class SegmentReclaimer
+{
+private:
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<long long> readers[2] = {{0}, {0}};
+    std::vector<std::pair<uint64_t, LogSegment *>> retired; // touched under the roll lock only
+
+public:
+    class Guard
+    {
+        std::atomic<long long> *counter;
+
+    public:
+        explicit Guard(std::atomic<long long> *counter) : counter(counter) {}
+        Guard(Guard &&other) : counter(other.counter) { other.counter = nullptr; }
+        ~Guard()
+        {
+            if (counter)
+                counter->fetch_sub(1);
+        }
+    };
+
+    ~SegmentReclaimer()
+    {
+        for (auto &entry : retired)
+            entry.second->release();
+    }
+
+    Guard enter()
+    {
+        while (true)
+        {
+            uint64_t current = epoch.load();
+            readers[current & 1].fetch_add(1);
+            if (epoch.load() == current)
+                return Guard(&readers[current & 1]);
+            readers[current & 1].fetch_sub(1);
+        }
+    }
+
+    void retire(LogSegment *segment)
+    {
+        retired.push_back({epoch.load(), segment});
+    }
+
+    // Advances the epoch when the previous one has drained and frees segments
+    // retired at least two epochs ago
+    void collect()
+    {
+        uint64_t current = epoch.load();
+        if (readers[(current + 1) & 1].load() == 0)
+            epoch.store(++current);
+        auto expired = std::remove_if(retired.begin(), retired.end(), [current](const std::pair<uint64_t, LogSegment *> &entry)
+                                      {
+            if (entry.first + 2 > current)
+                return false;
+            entry.second->release();
+            return true; });
+        retired.erase(expired, retired.end());
+    }
+};
+
+// Retention is applied to whole segments; the active segment is never deleted
+struct RetentionPolicy
+{
+    size_t maxBytes = 0;            // 0 keeps everything
+    std::chrono::seconds maxAge{0}; // 0 keeps everything
+};
+
+// Opt-in durability. Partition logs become segment files under `directory`, a syncer
+// thread group-commits them with one fdatasync per partition for every batch of
+// appends, and consumer-group offsets are checkpointed next to them.
+struct PersistenceOptions
+{
+    std::string directory;                      // empty keeps the topic in memory only
+    long long syncEveryMessages = 1000;         // sync once this many appends are pending...
+    std::chrono::milliseconds syncInterval{10}; // ...or this long after the last sync
+};
+
+// Append-only log of one topic partition. Messages get consecutive offsets and stay
+// readable by any number of consumer groups until retention drops their segment.
+// Appends and reads are lock-free; only rolling to a new segment takes a mutex.
+// With a storage path the segments are files in that directory, one per segment,
+// named by base offset, and the log is rebuilt from them on construction.
+class PartitionLog
+{
+private:
+    // Segments by sequence number, as a ring; also the cap on retained segments
+    static constexpr long long DIRECTORY_SIZE = 1 << 16;
+
+    int partition;
+    size_t segmentBytes;
+    RetentionPolicy retention;
+    std::string storagePath; // empty for an in-memory log
+    std::unique_ptr<std::atomic<LogSegment *>[]> directory;
+    std::atomic<long long> headSequence{0};
+    std::atomic<long long> tailSequence{0};
+    std::atomic<LogSegment *> active{nullptr};
+    size_t retainedBytes = 0;
+    std::mutex rollMutex;
+    SegmentReclaimer reclaimer;
+    std::mutex syncMutex;
+    long long syncedSequence = 0; // guarded by syncMutex; segments before it are fully synced
+    std::atomic<long long> durableEnd{0};
+
+    LogSegment *segmentAt(long long sequence) const
+    {
+        return directory[sequence & (DIRECTORY_SIZE - 1)].load();
+    }
+
+    void enforceRetention()
+    {
+        auto now = std::chrono::steady_clock::now();
+        while (headSequence < tailSequence)
+        {
+            LogSegment *oldest = segmentAt(headSequence);
+            bool tooBig = retention.maxBytes > 0 && retainedBytes > retention.maxBytes;
+            bool tooOld = retention.maxAge.count() > 0 && now - oldest->getCreatedAt() > retention.maxAge;
+            bool directoryFull = tailSequence - headSequence >= DIRECTORY_SIZE - 1;
+            if (!tooBig && !tooOld && !directoryFull)
+                break;
+            retainedBytes -= oldest->getCapacity();
+            headSequence++;
+            oldest->removeFile();
+            reclaimer.retire(oldest);
+        }
+        reclaimer.collect();
+    }
+
+    // Replaces `full` as the active segment unless another producer already did
+    void rollSegment(LogSegment *full, size_t minimumBytes)
+    {
+        std::lock_guard<std::mutex> lock(rollMutex);
+        if (active.load() != full)
+            return;
+        long long base = full ? full->seal() : 0;
+        size_t capacity = std::max(segmentBytes, minimumBytes);
+        size_t maxRecords = std::max<size_t>(64, capacity / 64);
+        LogSegment *segment = storagePath.empty() ? new LogSegment(base, capacity, maxRecords)
+                                                  : LogSegment::create(segmentPath(base), base, capacity, maxRecords);
+        long long sequence = full ? tailSequence + 1 : 0;
+        directory[sequence & (DIRECTORY_SIZE - 1)].store(segment);
+        tailSequence.store(sequence);
+        active.store(segment);
+        retainedBytes += capacity;
+        enforceRetention();
+    }
+
+    // Segment holding `offset`; requires a reclaimer guard
+    long long findSegment(long long offset) const
+    {
+        long long low = headSequence.load(), high = tailSequence.load();
+        while (low < high)
+        {
+            long long mid = (low + high + 1) / 2;
+            if (segmentAt(mid)->getBaseOffset() <= offset)
+                low = mid;
+            else
+                high = mid - 1;
+        }
+        return low;
+    }
+
+    std::string segmentPath(long long baseOffset) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%020lld.log", baseOffset);
+        return storagePath + name;
+    }
+
+    // Maps every segment file back in offset order. Only headers and slot tables are
+    // read, so the cost grows with the number of segments, not with the bytes retained.
+    // Offsets must stay contiguous: files after a gap left by a torn segment are dropped.
+    void recover()
+    {
+        std::vector<std::string> paths;
+        for (const auto &entry : std::filesystem::directory_iterator(storagePath))
+        {
+            if (entry.path().extension() == ".log")
+                paths.push_back(entry.path().string());
+        }
+        std::sort(paths.begin(), paths.end());
+
+        long long sequence = -1;
+        for (const std::string &path : paths)
+        {
+            LogSegment *segment = LogSegment::recover(path);
+            if (!segment)
+                continue;
+            if (sequence >= 0 && segment->getBaseOffset() != segmentAt(sequence)->getEndOffset())
+            {
+                segment->release();
+                ::unlink(path.c_str());
+                continue;
+            }
+            if (sequence >= 0)
+                segmentAt(sequence)->seal();
+            sequence++;
+            directory[sequence & (DIRECTORY_SIZE - 1)].store(segment);
+            retainedBytes += segment->getCapacity();
+        }
+        if (sequence < 0)
+        {
+            rollSegment(nullptr, 0);
+            return;
+        }
+        tailSequence.store(sequence);
+        active.store(segmentAt(sequence));
+        durableEnd.store(active.load()->getEndOffset());
+        std::lock_guard<std::mutex> lock(rollMutex);
+        enforceRetention();
+    }
+
+public:
+    explicit PartitionLog(int partition = 0, size_t segmentBytes = 1 << 20, RetentionPolicy retention = RetentionPolicy(),
+                          const std::string &storagePath = "")
+        : partition(partition), segmentBytes(segmentBytes), retention(retention), storagePath(storagePath),
+          directory(new std::atomic<LogSegment *>[DIRECTORY_SIZE])
+    {
+        if (storagePath.empty())
+        {
+            rollSegment(nullptr, 0);
+            return;
+        }
+        std::filesystem::create_directories(storagePath);
+        recover();
+    }
+
+    ~PartitionLog()
+    {
+        for (long long sequence = headSequence; sequence <= tailSequence; sequence++)
+            segmentAt(sequence)->release();
+    }
+
+    long long append(std::string_view content)
+    {
+        auto guard = reclaimer.enter();
+        while (true)
+        {
+            LogSegment *segment = active.load();
+            long long offset = segment->tryAppend(content);
+            if (offset >= 0)
+                return offset;
+            rollSegment(segment, content.size());
+        }
+    }
+
+    // Atomically claims up to maxMessages offsets from `cursor` and returns Messages that
+    // view the records in place. Several consumers may share one cursor; each offset is
+    // claimed exactly once.
+    // A cursor behind the retained range skips ahead to the oldest retained record.
+    std::vector<Message> claim(std::atomic<long long> &cursor, size_t maxMessages)
+    {
+        auto guard = reclaimer.enter();
+        long long start = segmentAt(headSequence)->getBaseOffset();
+        long long end = active.load()->getEndOffset();
+        long long current = cursor.load(), from, to;
+        do
+        {
+            from = std::max(current, start);
+            if (from >= end)
+                return {};
+            to = from + (long long)std::min<size_t>(maxMessages, end - from);
+        } while (!cursor.compare_exchange_weak(current, to));
+
+        std::vector<Message> messages;
+        messages.reserve(to - from);
+        long long sequence = findSegment(from);
+        for (long long offset = from; offset < to; offset++)
+        {
+            LogSegment *segment = segmentAt(sequence);
+            if (offset < segment->getBaseOffset())
+                continue; // dropped by retention after the claim
+            while (segment->isSealed() && offset >= segment->getEndOffset())
+                segment = segmentAt(++sequence);
+            messages.emplace_back(offset, segment->read(offset), segment, partition);
+        }
+        return messages;
+    }
+
+    long long getStartOffset()
+    {
+        auto guard = reclaimer.enter();
+        return segmentAt(headSequence)->getBaseOffset();
+    }
+
+    long long getEndOffset()
+    {
+        auto guard = reclaimer.enter();
+        return active.load()->getEndOffset();
+    }
+
+    // Flushes every record appended so far to disk and returns the new durable end.
+    // Concurrent appenders keep going; whatever they add meanwhile goes in the next sync.
+    long long sync()
+    {
+        if (storagePath.empty())
+            return getEndOffset();
+        std::lock_guard<std::mutex> lock(syncMutex);
+        auto guard = reclaimer.enter();
+        long long tail = tailSequence.load(), end = durableEnd.load();
+        for (long long sequence = std::max(syncedSequence, headSequence.load()); sequence <= tail; sequence++)
+        {
+            LogSegment *segment = segmentAt(sequence);
+            end = segment->getEndOffset();
+            segment->sync(end);
+        }
+        syncedSequence = tail;
+        durableEnd.store(end);
+        return end;
+    }
+
+    // Offsets below this survive a crash
+    long long getDurableEnd() const { return storagePath.empty() ? LLONG_MAX : durableEnd.load(); }
+
+    size_t getSegmentCount() const
+    {
+        return (size_t)(tailSequence - headSequence + 1);
+    }
 };
 
 class IConsumer
@@ -48,16 +758,28 @@ class Consumer : public IConsumer
 {
 private:
     std::string consumerId;
+    std::string groupId;
     set<std::string> subscribedTopics;
 
 public:
-    explicit Consumer(const std::string &id) : consumerId(id) {}
+    // A consumer without an explicit group forms a group of its own
+    explicit Consumer(const std::string &id, const std::string &group = "") : consumerId(id), groupId(group.empty() ? id : group) {}
 
     void receiveMessage(const Message &message) override
     {
         std::cout << consumerId << " received " << message.getContent() << std::endl;
     }
 
+    const std::string &getConsumerId() const
+    {
+        return consumerId;
+    }
+
+    const std::string &getGroupId() const
+    {
+        return groupId;
+    }
+
     void addSubscribedTopic(const std::string &topicName)
     {
         subscribedTopics.insert(topicName);
@@ -79,128 +801,813 @@ public:
     }
 };
 
-class Producer
+// Where a produced message was stored
+struct RecordMetadata
 {
-public:
-    void produceMessage(ITopic *topic, const std::string &content)
-    {
-        Message *message = new Message(content);
-        topic->addMessage(message);
-    }
+    int partition;
+    long long offset;
 };
 
 class ITopic
 {
 public:
-    virtual void addMessage(Message *message) = 0;
-    virtual Message *getNextMessage() = 0;
+    virtual RecordMetadata addMessage(std::string_view content) = 0;
+    virtual RecordMetadata addMessage(const std::string &key, std::string_view content) = 0;
+    virtual std::vector<Message> pollBatch(Consumer *consumer, size_t maxMessages, std::chrono::milliseconds timeout) = 0;
+    virtual void seek(const std::string &groupId, int partition, long long offset) = 0;
     virtual void subscribe(Consumer *consumer) = 0;
     virtual void unsubscribe(Consumer *consumer) = 0;
     virtual std::set<Consumer *> getSubscribers() const = 0;
     virtual ~ITopic() = default;
 };
 
+struct ConsumerGroup;
+
+// One consumer's membership in a group. `wakeups` is the futex word it sleeps on;
+// producers wake it only when a partition it owns receives data.
+struct GroupMember
+{
+    Consumer *consumer;
+    ConsumerGroup *group;
+    bool active = true;    // guarded by the topic mutex
+    int nextPartition = 0; // where the next poll starts, so owned partitions are served round-robin
+    std::atomic<uint32_t> wakeups{0};
+    std::atomic<int> waiters{0};
+    std::atomic<bool> wakePending{false};
+
+    GroupMember(Consumer *consumer, ConsumerGroup *group) : consumer(consumer), group(group) {}
+
+    void wakeOne()
+    {
+        if (!wakePending.exchange(true))
+        {
+            wakeups.fetch_add(1);
+            futexWake(&wakeups, 1);
+        }
+    }
+};
+
+// Read positions of one consumer group, one per partition, and the member that owns
+// each partition. Members that leave stay allocated and own nothing, so producers
+// can follow `owners` without taking a lock.
+struct ConsumerGroup
+{
+    int partitionCount;
+    std::unique_ptr<std::atomic<long long>[]> offsets;
+    std::unique_ptr<std::atomic<GroupMember *>[]> owners;
+    std::vector<std::unique_ptr<GroupMember>> members; // guarded by the topic mutex
+
+    explicit ConsumerGroup(int partitionCount)
+        : partitionCount(partitionCount), offsets(new std::atomic<long long>[partitionCount]),
+          owners(new std::atomic<GroupMember *>[partitionCount])
+    {
+        for (int partition = 0; partition < partitionCount; partition++)
+        {
+            offsets[partition].store(0);
+            owners[partition].store(nullptr);
+        }
+    }
+
+    // Range assignment: with the active members sorted by id, member i of n owns
+    // partitions [i * P / n, (i + 1) * P / n). Every member is woken to pick up the
+    // change. A batch already claimed by the previous owner is still delivered by it.
+    void rebalance()
+    {
+        std::vector<GroupMember *> active;
+        for (auto &member : members)
+        {
+            if (member->active)
+                active.push_back(member.get());
+        }
+        std::sort(active.begin(), active.end(), [](GroupMember *a, GroupMember *b)
+                  { return a->consumer->getConsumerId() < b->consumer->getConsumerId(); });
+        for (int partition = 0; partition < partitionCount; partition++)
+            owners[partition].store(active.empty() ? nullptr : active[(size_t)partition * active.size() / partitionCount]);
+        for (auto &member : members)
+            member->wakeOne();
+    }
+};
+
 class Topic : public ITopic
 {
 private:
+    static constexpr int MAX_GROUPS = 64;
+
     std::string name;
-    std::deque<Message *> messageQueue;
-    std::set<Consumers *> subscribers;
-    std::mutex queueMutex;
-    std::condition_variable queueCV;
+    std::vector<std::unique_ptr<PartitionLog>> partitions;
+    std::atomic<unsigned> nextPartition{0}; // round-robin target for keyless messages
+    std::unordered_map<std::string, std::unique_ptr<ConsumerGroup>> groups;
+    // Append-only copy of the groups that producers scan without locking
+    std::atomic<ConsumerGroup *> groupList[MAX_GROUPS] = {};
+    std::atomic<int> groupCount{0};
+    std::unordered_map<Consumer *, GroupMember *> members;
+    mutable std::mutex topicMutex;
+
+    PersistenceOptions persistence;
+    bool persistent;
+    std::atomic<long long> unsynced{0};
+    std::mutex syncMutex;
+    std::condition_variable syncCV;    // wakes the syncer early
+    std::condition_variable durableCV; // wakes producers in waitDurable()
+    bool stopping = false;             // guarded by syncMutex
+    std::mutex checkpointMutex;
+    std::string lastCheckpoint; // guarded by checkpointMutex
+    std::thread syncer;
+
+    // Requires topicMutex
+    ConsumerGroup &getGroup(const std::string &groupId)
+    {
+        auto &group = groups[groupId];
+        if (!group)
+        {
+            if (groupCount == MAX_GROUPS)
+                throw std::runtime_error("too many consumer groups on topic " + name);
+            group = std::make_unique<ConsumerGroup>((int)partitions.size());
+            groupList[groupCount].store(group.get());
+            groupCount++;
+        }
+        return *group;
+    }
+
+    GroupMember &getMember(Consumer *consumer)
+    {
+        std::lock_guard<std::mutex> lock(topicMutex);
+        auto it = members.find(consumer);
+        if (it == members.end())
+            throw std::runtime_error("consumer is not subscribed to topic " + name);
+        return *it->second;
+    }
+
+    void checkPartition(int partition) const
+    {
+        if (partition < 0 || partition >= (int)partitions.size())
+            throw std::out_of_range("no partition " + std::to_string(partition) + " in topic " + name);
+    }
+
+    // Wakes the owner of `partition` in each group, if it is sleeping
+    void wakeOwners(int partition)
+    {
+        int count = groupCount.load();
+        for (int i = 0; i < count; i++)
+        {
+            GroupMember *owner = groupList[i].load()->owners[partition].load();
+            if (owner && owner->waiters.load() > 0)
+                owner->wakeOne();
+        }
+    }
+
+    RecordMetadata append(int partition, std::string_view content)
+    {
+        long long offset = partitions[partition]->append(content);
+        if (persistent && unsynced.fetch_add(1) + 1 == persistence.syncEveryMessages)
+            syncCV.notify_one();
+        wakeOwners(partition);
+        return {partition, offset};
+    }
+
+    // Group commit: each round makes every append since the previous one durable
+    void syncLoop()
+    {
+        std::unique_lock<std::mutex> lock(syncMutex);
+        while (!stopping)
+        {
+            syncCV.wait_for(lock, persistence.syncInterval, [this]()
+                            { return stopping || unsynced.load() >= persistence.syncEveryMessages; });
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    std::string checkpointPath() const
+    {
+        return persistence.directory + "/" + name + ".offsets";
+    }
+
+    // Parses the whole string as a number; false for anything else
+    template <typename T>
+    static bool parseNumber(const std::string &text, T &value)
+    {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    // The checkpoint holds one "<group>\t<partition>\t<offset>" line per group and partition.
+    // Corrupt lines are skipped, so those groups restart from the beginning of the log.
+    void loadCheckpoint()
+    {
+        std::ifstream file(checkpointPath());
+        std::string line;
+        while (std::getline(file, line))
+        {
+            size_t offsetTab = line.rfind('\t');
+            size_t partitionTab = offsetTab == std::string::npos || offsetTab == 0 ? std::string::npos : line.rfind('\t', offsetTab - 1);
+            if (partitionTab == std::string::npos)
+                continue;
+            int index;
+            long long value;
+            if (!parseNumber(line.substr(partitionTab + 1, offsetTab - partitionTab - 1), index) ||
+                !parseNumber(line.substr(offsetTab + 1), value) || value < 0)
+                continue;
+            if (index >= 0 && index < (int)partitions.size())
+                getGroup(line.substr(0, partitionTab)).offsets[index].store(value);
+        }
+    }
+
+    // Written to a temporary file and renamed over the old one, so a crash leaves one
+    // complete checkpoint or the other. Unchanged offsets are not rewritten.
+    void checkpointOffsets()
+    {
+        std::string contents;
+        {
+            std::lock_guard<std::mutex> lock(topicMutex);
+            for (auto &entry : groups)
+            {
+                for (int partition = 0; partition < (int)partitions.size(); partition++)
+                    contents += entry.first + "\t" + std::to_string(partition) + "\t" + std::to_string(entry.second->offsets[partition].load()) + "\n";
+            }
+        }
+        std::lock_guard<std::mutex> lock(checkpointMutex);
+        if (contents == lastCheckpoint)
+            return;
+        std::string temporary = checkpointPath() + ".tmp";
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return;
+        bool written = ::write(fd, contents.data(), contents.size()) == (ssize_t)contents.size() && ::fsync(fd) == 0;
+        ::close(fd);
+        if (written && ::rename(temporary.c_str(), checkpointPath().c_str()) == 0)
+            lastCheckpoint = contents;
+    }
+
+    bool hasBacklog(const GroupMember &member) const
+    {
+        for (int partition = 0; partition < (int)partitions.size(); partition++)
+        {
+            if (member.group->owners[partition].load() == &member &&
+                partitions[partition]->getEndOffset() > member.group->offsets[partition].load())
+                return true;
+        }
+        return false;
+    }
 
 public:
-    explicit Topic(const std::string &name) : name(name) {}
+    // A persistent topic picks up the partitions and group offsets found under the
+    // persistence directory, so consumers resume where the last checkpoint left them
+    explicit Topic(const std::string &name, int partitionCount = 1, size_t segmentBytes = 1 << 20, RetentionPolicy retention = RetentionPolicy(),
+                   PersistenceOptions persistence = PersistenceOptions())
+        : name(name), persistence(persistence), persistent(!persistence.directory.empty())
+    {
+        for (int partition = 0; partition < std::max(1, partitionCount); partition++)
+        {
+            std::string storagePath = persistent ? persistence.directory + "/" + name + "-" + std::to_string(partition) : "";
+            partitions.push_back(std::make_unique<PartitionLog>(partition, segmentBytes, retention, storagePath));
+        }
+        if (persistent)
+        {
+            loadCheckpoint();
+            syncer = std::thread(&Topic::syncLoop, this);
+        }
+    }
 
-    void addMessage(Message *message) override
+    ~Topic()
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        messageQueue.push_back(message);
-        queueCV.notify_all();
+        if (!persistent)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(syncMutex);
+            stopping = true;
+        }
+        syncCV.notify_one();
+        syncer.join();
+        flush();
     }
 
-    Message *getNextMessage() override
+    // Makes everything appended so far durable and checkpoints the group offsets
+    void flush()
     {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        while (messageQueue.empty())
+        if (!persistent)
+            return;
+        unsynced.store(0);
+        for (auto &partition : partitions)
+            partition->sync();
+        checkpointOffsets();
         {
-            queueCV.wait(lock);
+            std::lock_guard<std::mutex> lock(syncMutex);
         }
-        if (messageQueue.empty())
-            return nullptr;
-        Message *message = messageQueue.front();
-        messageQueue.pop_front();
-        return message;
+        durableCV.notify_all();
+    }
+
+    // Blocks until `record` would survive a crash. Producers waiting together share
+    // the syncer's next group commit instead of paying for an fsync each.
+    void waitDurable(const RecordMetadata &record)
+    {
+        PartitionLog &log = *partitions[record.partition];
+        std::unique_lock<std::mutex> lock(syncMutex);
+        durableCV.wait(lock, [&]()
+                       { return log.getDurableEnd() > record.offset || stopping; });
+    }
+
+    int getPartitionCount() const { return (int)partitions.size(); }
+
+    // Messages with equal keys always map to the same partition, which keeps their order
+    int partitionFor(const std::string &key) const
+    {
+        return (int)(std::hash<std::string>()(key) % partitions.size());
+    }
+
+    // Keyless messages are spread over the partitions round-robin
+    RecordMetadata addMessage(std::string_view content) override
+    {
+        return append((int)(nextPartition.fetch_add(1) % partitions.size()), content);
+    }
+
+    RecordMetadata addMessage(const std::string &key, std::string_view content) override
+    {
+        return append(partitionFor(key), content);
+    }
+
+    // Returns up to maxMessages from one of the partitions this consumer owns in its
+    // group, advancing that partition's offset; sleeps up to `timeout` when all of its
+    // partitions have caught up. A member is polled by one thread at a time.
+    std::vector<Message> pollBatch(Consumer *consumer, size_t maxMessages, std::chrono::milliseconds timeout) override
+    {
+        GroupMember &member = getMember(consumer);
+        ConsumerGroup &group = *member.group;
+        int count = (int)partitions.size();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true)
+        {
+            // Any wake sent after this point also bumps `wakeups` past `seen`
+            member.wakePending.store(false);
+            uint32_t seen = member.wakeups.load();
+            for (int i = 0; i < count; i++)
+            {
+                int partition = (member.nextPartition + i) % count;
+                if (group.owners[partition].load() != &member)
+                    continue;
+                std::vector<Message> messages = partitions[partition]->claim(group.offsets[partition], maxMessages);
+                if (!messages.empty())
+                {
+                    member.nextPartition = (partition + 1) % count;
+                    return messages;
+                }
+            }
+
+            // Announce the wait, then re-check so a concurrent append cannot be missed
+            member.waiters++;
+            auto remaining = deadline - std::chrono::steady_clock::now();
+            if (hasBacklog(member) || remaining <= std::chrono::nanoseconds::zero())
+            {
+                member.waiters--;
+                if (remaining <= std::chrono::nanoseconds::zero())
+                    return {};
+                continue;
+            }
+            futexWait(&member.wakeups, seen, remaining);
+            member.waiters--;
+        }
+    }
+
+    // Moves a group's offset in one partition, e.g. back to getStartOffset() to replay it
+    void seek(const std::string &groupId, int partition, long long offset) override
+    {
+        checkPartition(partition);
+        std::lock_guard<std::mutex> lock(topicMutex);
+        getGroup(groupId).offsets[partition].store(offset);
+    }
+
+    long long getStartOffset(int partition)
+    {
+        checkPartition(partition);
+        return partitions[partition]->getStartOffset();
+    }
+
+    long long getEndOffset(int partition)
+    {
+        checkPartition(partition);
+        return partitions[partition]->getEndOffset();
+    }
+
+    size_t getSegmentCount(int partition) const
+    {
+        checkPartition(partition);
+        return partitions[partition]->getSegmentCount();
+    }
+
+    // Partitions the consumer currently owns in its group
+    std::vector<int> getAssignment(Consumer *consumer)
+    {
+        GroupMember &member = getMember(consumer);
+        std::vector<int> assigned;
+        for (int partition = 0; partition < (int)partitions.size(); partition++)
+        {
+            if (member.group->owners[partition].load() == &member)
+                assigned.push_back(partition);
+        }
+        return assigned;
     }
 
+    // Joins the consumer's group and rebalances the group's partitions
     void subscribe(Consumer *consumer) override
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        subscribers.insert(consumer);
+        std::lock_guard<std::mutex> lock(topicMutex);
+        if (members.count(consumer))
+            return;
+        ConsumerGroup &group = getGroup(consumer->getGroupId());
+        group.members.push_back(std::make_unique<GroupMember>(consumer, &group));
+        members[consumer] = group.members.back().get();
+        group.rebalance();
     }
 
+    // Leaves the group; its partitions move to the remaining members
     void unsubscribe(Consumer *consumer) override
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        subscribers.erase(consumer);
+        std::lock_guard<std::mutex> lock(topicMutex);
+        auto it = members.find(consumer);
+        if (it == members.end())
+            return;
+        GroupMember *member = it->second;
+        members.erase(it);
+        member->active = false;
+        member->group->rebalance();
     }
 
     std::set<Consumer *> getSubscribers() const override
     {
+        std::lock_guard<std::mutex> lock(topicMutex);
+        std::set<Consumer *> subscribers;
+        for (auto &entry : members)
+            subscribers.insert(entry.first);
         return subscribers;
     }
 
     std::string getName() const { return name; }
 
+    // Delivers to each subscriber whatever its own partitions hold that it has not yet read
     void notifySubscribers()
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        for (auto &subscriber : subscribers)
+        for (Consumer *subscriber : getSubscribers())
         {
-            while (!messageQueue.empty())
+            std::vector<Message> messages;
+            while (!(messages = pollBatch(subscriber, SIZE_MAX, std::chrono::milliseconds(0))).empty())
             {
-                Message *message = messageQueue.front();
-                messageQueue.pop_front();
-                subscriber->receiveMessage(*message);
-                delete message; // Clean up message after sending
+                for (const Message &message : messages)
+                    subscriber->receiveMessage(message);
             }
         }
     }
 };
 
+class IProducer
+{
+public:
+    virtual ~IProducer() = default;
+    virtual void produceMessage(ITopic *topic, std::string_view content) = 0;
+    virtual void produceMessage(ITopic *topic, const std::string &key, std::string_view content) = 0;
+};
+
+class Producer : public IProducer
+{
+public:
+    void produceMessage(ITopic *topic, std::string_view content) override
+    {
+        topic->addMessage(content);
+    }
+
+    void produceMessage(ITopic *topic, const std::string &key, std::string_view content) override
+    {
+        topic->addMessage(key, content);
+    }
+};
+
 void producerFunction(Producer *producer, Topic *topic, const std::vector<std::string> &messages)
 {
     for (const auto &message : messages)
     {
-        producer->produceMessage(topic, new Message(message));
+        producer->produceMessage(topic, message);
     }
 }
 
-void consumerFunction(Consumer *consumer, Topic *topic)
+// Polls until the producers are done and the consumer's partitions have caught up
+void consumerFunction(Consumer *consumer, Topic *topic, const std::atomic<bool> *producersDone)
 {
     while (true)
     {
-        Message *message = topic->getNextMessage();
-        if (message)
+        bool finished = *producersDone;
+        std::vector<Message> messages = topic->pollBatch(consumer, 16, std::chrono::milliseconds(50));
+        for (const Message &message : messages)
         {
-            consumer->receiveMessage(*message);
-            delete message; // Clean up message after processing
+            consumer->receiveMessage(message);
         }
+        if (messages.empty() && finished)
+            return;
     }
 }
 
-int main()
+// The previous Topic design, kept for comparison: one mutex around a deque of
+// heap-allocated messages and a notify_all per message
+class LockedMessageQueue
 {
-    // Create topics
-    Topic topic1("topic1");
+private:
+    std::deque<Message *> messageQueue;
+    std::mutex queueMutex;
+    std::condition_variable queueCV;
+
+public:
+    void addMessage(Message *message)
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        messageQueue.push_back(message);
+        queueCV.notify_all();
+    }
+
+    Message *getNextMessage()
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        while (messageQueue.empty())
+        {
+            queueCV.wait(lock);
+        }
+        Message *message = messageQueue.front();
+        messageQueue.pop_front();
+        return message;
+    }
+};
+
+// Moves `total` keyed messages from `threads` producers to `threads` consumers sharing
+// one group and returns millions of messages per second
+double runQueueBenchmark(int threads, long long total, bool lockFree, int partitionCount = 1)
+{
+    Topic topic("bench", partitionCount, 4 << 20);
+    LockedMessageQueue lockedQueue;
+    std::atomic<long long> consumed{0};
+    std::string payload(64, 'x');
+    std::vector<std::string> keys;
+    for (int k = 0; k < 1024; k++)
+        keys.push_back("key-" + std::to_string(k));
+    std::vector<std::unique_ptr<Consumer>> consumers;
+    for (int t = 0; t < threads; t++)
+    {
+        consumers.push_back(std::make_unique<Consumer>("worker-" + std::to_string(t), "workers"));
+        topic.subscribe(consumers.back().get());
+    }
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+            for (long long i = t; i < total; i += threads)
+            {
+                if (lockFree)
+                    topic.addMessage(keys[i % keys.size()], payload);
+                else
+                    lockedQueue.addMessage(new Message(i, payload));
+            } });
+        workers.emplace_back([&, t]()
+                             {
+            if (lockFree)
+            {
+                while (consumed < total)
+                    consumed += topic.pollBatch(consumers[t].get(), 256, std::chrono::milliseconds(10)).size();
+                return;
+            }
+            while (true)
+            {
+                Message *message = lockedQueue.getNextMessage();
+                if (!message)
+                    return;
+                consumed++;
+                delete message;
+            } });
+    }
+    if (!lockFree)
+    {
+        // Poison pills once everything has been consumed
+        while (consumed < total)
+            std::this_thread::yield();
+        for (int t = 0; t < threads; t++)
+            lockedQueue.addMessage(nullptr);
+    }
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total / seconds / 1e6;
+}
+
+void benchmarkQueues()
+{
+    const long long total = 400000;
+    std::cout << "threads/side  mutex+notify_all(Mmsg/s)  lock-free+pollBatch(Mmsg/s)" << std::endl;
+    for (int threads : {1, 4, 16})
+    {
+        double locked = runQueueBenchmark(threads, total, false);
+        double lockFree = runQueueBenchmark(threads, total, true);
+        std::cout << std::setw(12) << threads << std::setw(26) << locked << std::setw(29) << lockFree << std::endl;
+    }
+}
+
+// Same load at 16 threads per side; with more partitions the consumers stop sharing
+// one cursor and each drains its own partitions
+void benchmarkPartitions()
+{
+    const long long total = 400000;
+    std::cout << "partitions  Mmsg/s (16 producers, 16 consumers)" << std::endl;
+    for (int partitionCount : {1, 4, 16})
+        std::cout << std::setw(10) << partitionCount << std::setw(10) << runQueueBenchmark(16, total, true, partitionCount) << std::endl;
+}
+
+// Bytes currently allocated through malloc/new, including mmapped chunks
+size_t heapBytesInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+struct FanOutResult
+{
+    double deliveriesPerSecond;
+    size_t copiedBytes;
+    size_t peakHeapBytes; // above the heap in use before the topic was created
+};
+
+// Publishes `count` messages of `size` bytes once and lets `groups` consumer groups read
+// all of them. With copyOut every delivered batch is copied into std::strings, as the
+// old by-value Message did; otherwise consumers read the shared log bytes in place.
+// A sampler thread records the peak heap in use while the topic is alive.
+FanOutResult runFanOutBenchmark(size_t size, int count, int groups, bool copyOut)
+{
+    size_t baseline = heapBytesInUse();
+    std::atomic<size_t> peak{0};
+    std::atomic<bool> sampling{true};
+    std::thread sampler([&]()
+                        {
+        while (sampling)
+        {
+            peak = std::max(peak.load(), heapBytesInUse());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } });
+
+    FanOutResult result;
+    {
+        Topic topic("payloads", 1, 4 << 20);
+        std::vector<std::unique_ptr<Consumer>> consumers;
+        for (int g = 0; g < groups; g++)
+        {
+            consumers.push_back(std::make_unique<Consumer>("reader-" + std::to_string(g)));
+            topic.subscribe(consumers.back().get());
+        }
+        std::string payload(size, 'p');
+        std::atomic<size_t> copied{0};
+        std::atomic<long long> checksum{0};
+        std::vector<std::thread> readers;
+
+        auto start = std::chrono::steady_clock::now();
+        std::thread producer([&]()
+                             {
+            for (int i = 0; i < count; i++)
+                topic.addMessage(payload); });
+        for (int g = 0; g < groups; g++)
+        {
+            readers.emplace_back([&, g]()
+                                 {
+                long long read = 0, sum = 0;
+                size_t bytes = 0;
+                std::vector<std::string> copies;
+                while (read < count)
+                {
+                    std::vector<Message> batch = topic.pollBatch(consumers[g].get(), 64, std::chrono::milliseconds(10));
+                    if (copyOut)
+                    {
+                        copies.clear();
+                        for (const Message &message : batch)
+                            copies.emplace_back(message.getContent());
+                        batch.clear();
+                        for (const std::string &content : copies)
+                        {
+                            sum += content[size / 2];
+                            bytes += content.size();
+                        }
+                    }
+                    else
+                    {
+                        for (const Message &message : batch)
+                            sum += message.getContent()[size / 2];
+                    }
+                    read += copyOut ? copies.size() : batch.size();
+                }
+                copied += bytes;
+                checksum += sum; });
+        }
+        producer.join();
+        for (auto &reader : readers)
+            reader.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.deliveriesPerSecond = (double)count * groups / seconds;
+        result.copiedBytes = copied;
+    }
+    sampling = false;
+    sampler.join();
+    result.peakHeapBytes = peak > baseline ? peak - baseline : 0;
+    return result;
+}
+
+// Reads one record, lets retention drop its segment, then compares the heap in use while
+// the Message is held with the heap after it is released
+void benchmarkSegmentPinning()
+{
+    const size_t segmentBytes = 4 << 20;
+    const size_t size = 1 << 10;
+    RetentionPolicy retention;
+    retention.maxBytes = segmentBytes;
+    Topic topic("pinning", 1, segmentBytes, retention);
+    Consumer holder("holder");
+    topic.subscribe(&holder);
+    std::string payload(size, 'p');
+    topic.addMessage(payload);
+    std::vector<Message> held = topic.pollBatch(&holder, 1, std::chrono::milliseconds(10));
+    for (size_t i = 0; i < 4 * segmentBytes / size; i++)
+        topic.addMessage(payload);
+    size_t pinned = heapBytesInUse();
+    held.clear();
+    size_t released = heapBytesInUse();
+    std::cout << "releasing one held 1 KB Message whose " << (segmentBytes >> 20) << " MB segment retention dropped frees "
+              << ((pinned - released) >> 10) << " KB" << std::endl;
+}
+
+void benchmarkPayloads()
+{
+    const int groups = 4;
+    const size_t totalBytes = 64 << 20;
+    std::cout << "payload  groups  log MB  copying: Kdeliveries/s  copied MB  peak heap MB"
+              << "  zero-copy: Kdeliveries/s  copied MB  peak heap MB" << std::endl;
+    for (size_t size : {size_t(1) << 10, size_t(64) << 10})
+    {
+        int count = (int)(totalBytes / size);
+        FanOutResult copying = runFanOutBenchmark(size, count, groups, true);
+        FanOutResult zeroCopy = runFanOutBenchmark(size, count, groups, false);
+        std::cout << std::setw(5) << (size >> 10) << " KB" << std::setw(8) << groups << std::setw(8) << (totalBytes >> 20)
+                  << std::setw(24) << copying.deliveriesPerSecond / 1e3 << std::setw(11) << (copying.copiedBytes >> 20)
+                  << std::setw(14) << (copying.peakHeapBytes >> 20)
+                  << std::setw(26) << zeroCopy.deliveriesPerSecond / 1e3 << std::setw(11) << (zeroCopy.copiedBytes >> 20)
+                  << std::setw(14) << (zeroCopy.peakHeapBytes >> 20) << std::endl;
+    }
+    benchmarkSegmentPinning();
+}
+
+// Fills a persistent topic with `backlogBytes` of 1 KB messages, then reopens it and
+// times recovery against reading the whole backlog back
+void benchmarkDurability()
+{
+    PersistenceOptions persistence;
+    persistence.directory = (std::filesystem::temp_directory_path() / "distributed-queue-bench").string();
+    const size_t segmentBytes = 4 << 20;
+    std::string payload(1024, 'd');
+    std::cout << "backlog MB  segments  append Mmsg/s  recover ms  read all ms" << std::endl;
+    for (size_t backlogBytes : {size_t(64) << 20, size_t(512) << 20})
+    {
+        std::filesystem::remove_all(persistence.directory);
+        long long count = (long long)(backlogBytes / payload.size());
+        auto start = std::chrono::steady_clock::now();
+        {
+            Topic topic("backlog", 1, segmentBytes, RetentionPolicy(), persistence);
+            for (long long i = 0; i < count; i++)
+                topic.addMessage(payload);
+        }
+        double appendSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        Topic topic("backlog", 1, segmentBytes, RetentionPolicy(), persistence);
+        double recoverMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        Consumer reader("reader");
+        topic.subscribe(&reader);
+        long long read = 0;
+        start = std::chrono::steady_clock::now();
+        while (read < count)
+            read += topic.pollBatch(&reader, 4096, std::chrono::milliseconds(0)).size();
+        double readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << std::setw(10) << (backlogBytes >> 20) << std::setw(10) << topic.getSegmentCount(0) << std::setw(15) << count / appendSeconds / 1e6
+                  << std::setw(12) << recoverMs << std::setw(13) << readMs << std::endl;
+    }
+    std::filesystem::remove_all(persistence.directory);
+}
+
+int main(int argc, char *argv[])
+{
+    // Create topics; topic1 has two partitions
+    Topic topic1("topic1", 2);
     Topic topic2("topic2");
 
-    // Create consumers
+    // Create consumers; consumer2 and consumer5 share a group and own one partition each
     Consumer consumer1("consumer1");
-    Consumer consumer2("consumer2");
+    Consumer consumer2("consumer2", "billing");
     Consumer consumer3("consumer3");
     Consumer consumer4("consumer4");
-    Consumer consumer5("consumer5");
+    Consumer consumer5("consumer5", "billing");
 
     // Subscribe consumers to topics
     topic1.subscribe(&consumer1);
@@ -229,28 +1636,30 @@ int main()
     // Messages to publish
     std::vector<std::string> messagesProducer1 = {"Message 1", "Message 2"};
     std::vector<std::string> messagesProducer2 = {"Message 3", "Message 5"};
+    std::atomic<bool> producersDone{false};
 
     // Launch producer threads
     std::thread producerThread1(producerFunction, &producer1, &topic1, messagesProducer1);
-    std::thread producerThread2(producerFunction, &producer2, &topic1, {"Message 3"});
-    std::thread producerThread3(producerFunction, &producer1, &topic2, {"Message 4"});
+    std::thread producerThread2(producerFunction, &producer2, &topic1, std::vector<std::string>{"Message 3"});
+    std::thread producerThread3(producerFunction, &producer1, &topic2, std::vector<std::string>{"Message 4"});
     std::thread producerThread4(producerFunction, &producer2, &topic2, messagesProducer2);
 
     // Launch consumer threads
-    std::thread consumerThread1(consumerFunction, &consumer1, &topic1);
-    std::thread consumerThread2(consumerFunction, &consumer2, &topic1);
-    std::thread consumerThread3(consumerFunction, &consumer3, &topic1);
-    std::thread consumerThread4(consumerFunction, &consumer4, &topic1);
-    std::thread consumerThread5(consumerFunction, &consumer5, &topic1);
-    std::thread consumerThread6(consumerFunction, &consumer1, &topic2);
-    std::thread consumerThread7(consumerFunction, &consumer3, &topic2);
-    std::thread consumerThread8(consumerFunction, &consumer4, &topic2);
+    std::thread consumerThread1(consumerFunction, &consumer1, &topic1, &producersDone);
+    std::thread consumerThread2(consumerFunction, &consumer2, &topic1, &producersDone);
+    std::thread consumerThread3(consumerFunction, &consumer3, &topic1, &producersDone);
+    std::thread consumerThread4(consumerFunction, &consumer4, &topic1, &producersDone);
+    std::thread consumerThread5(consumerFunction, &consumer5, &topic1, &producersDone);
+    std::thread consumerThread6(consumerFunction, &consumer1, &topic2, &producersDone);
+    std::thread consumerThread7(consumerFunction, &consumer3, &topic2, &producersDone);
+    std::thread consumerThread8(consumerFunction, &consumer4, &topic2, &producersDone);
 
     // Join threads
     producerThread1.join();
     producerThread2.join();
     producerThread3.join();
     producerThread4.join();
+    producersDone = true;
 
     consumerThread1.join();
     consumerThread2.join();
@@ -261,5 +1670,78 @@ int main()
     consumerThread7.join();
     consumerThread8.join();
 
+    // Replay: rewind consumer1's group to the oldest retained offset of every partition
+    for (int partition = 0; partition < topic1.getPartitionCount(); partition++)
+        topic1.seek(consumer1.getGroupId(), partition, topic1.getStartOffset(partition));
+    std::vector<Message> replayed;
+    while (!(replayed = topic1.pollBatch(&consumer1, SIZE_MAX, std::chrono::milliseconds(0))).empty())
+    {
+        for (const Message &message : replayed)
+            std::cout << "replayed partition " << message.getPartition() << " offset " << message.getOffset() << ": " << message.getContent() << std::endl;
+    }
+
+    // Keyed messages: every event of an order lands in one partition, in order. When a
+    // member of the "shipping" group leaves, its partitions move to the others.
+    Topic orders("orders", 4);
+    Consumer shipper1("shipper1", "shipping");
+    Consumer shipper2("shipper2", "shipping");
+    orders.subscribe(&shipper1);
+    orders.subscribe(&shipper2);
+    Producer orderProducer;
+    for (const char *event : {"placed", "packed", "shipped"})
+    {
+        for (int order = 1; order <= 3; order++)
+            orderProducer.produceMessage(&orders, "order-" + std::to_string(order), "order-" + std::to_string(order) + " " + std::string(event));
+    }
+    for (Consumer *shipper : {&shipper1, &shipper2})
+    {
+        std::cout << shipper->getConsumerId() << " owns partitions";
+        for (int partition : orders.getAssignment(shipper))
+            std::cout << " " << partition;
+        std::cout << std::endl;
+    }
+    orders.unsubscribe(&shipper2);
+    std::cout << "after shipper2 leaves, shipper1 owns " << orders.getAssignment(&shipper1).size() << " partitions" << std::endl;
+    orders.notifySubscribers();
+
+    // Persistence: the "payments" log and its group's offset survive reopening the topic
+    PersistenceOptions persistence;
+    persistence.directory = (std::filesystem::temp_directory_path() / "distributed-queue-demo").string();
+    std::filesystem::remove_all(persistence.directory);
+    Consumer auditor("auditor");
+    {
+        Topic payments("payments", 1, 1 << 20, RetentionPolicy(), persistence);
+        payments.subscribe(&auditor);
+        for (int i = 1; i <= 5; i++)
+            payments.waitDurable(payments.addMessage("payment " + std::to_string(i)));
+        for (const Message &message : payments.pollBatch(&auditor, 2, std::chrono::milliseconds(0)))
+            auditor.receiveMessage(message);
+    }
+    {
+        Topic payments("payments", 1, 1 << 20, RetentionPolicy(), persistence);
+        payments.subscribe(&auditor);
+        std::cout << "payments reopened with offsets [" << payments.getStartOffset(0) << ", " << payments.getEndOffset(0) << ")" << std::endl;
+        payments.notifySubscribers();
+    }
+    std::filesystem::remove_all(persistence.directory);
+
+    // Retention drops whole segments once the log exceeds its byte budget
+    RetentionPolicy retention;
+    retention.maxBytes = 4096;
+    Topic metrics("metrics", 1, 1024, retention);
+    for (int i = 0; i < 1000; i++)
+        metrics.addMessage("cpu=" + std::to_string(i % 100));
+    std::cout << "metrics retains offsets [" << metrics.getStartOffset(0) << ", " << metrics.getEndOffset(0) << ") in "
+              << metrics.getSegmentCount(0) << " segments" << std::endl;
+
+    // The benchmarks write hundreds of megabytes of segment files, so they only run on request
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        benchmarkQueues();
+        benchmarkPartitions();
+        benchmarkPayloads();
+        benchmarkDurability();
+    }
+
     return 0;
-}
\ No newline at end of file
+}
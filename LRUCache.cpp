@@ -17,22 +17,367 @@ store frequently accessed data as a key-value pair.
 #include <bits/stdc++.h>
 using namespace std;
 
-// Interface for cache eviction strategy
+// Interface for cache eviction strategy. A strategy owns whatever metadata its
+// policy needs and is told about every insertion and hit; when the cache is full it
+// picks a victim, forgets it and returns its key.
 class EvictionStrategy
 {
 public:
-    virtual void evict(list<pair<int, int>> &keys) = 0;
+    virtual void setCapacity(int) {}
+    virtual void keyAdded(int key) = 0;
+    virtual void keyAccessed(int key) = 0;
+    virtual int evict() = 0;
     virtual ~EvictionStrategy() = default;
 };
 
 // LRU eviction strategy
 class LRUStrategy : public EvictionStrategy
 {
+    list<int> order;
+    unordered_map<int, list<int>::iterator> position;
+
+public:
+    void keyAdded(int key) override
+    {
+        order.push_front(key);
+        position[key] = order.begin();
+    }
+
+    void keyAccessed(int key) override
+    {
+        order.splice(order.begin(), order, position[key]);
+    }
+
+    int evict() override
+    {
+        int key = order.back();
+        order.pop_back();
+        position.erase(key);
+        return key;
+    }
+};
+
+// CLOCK eviction strategy: a hit only sets a reference bit, and the hand sweeps the
+// ring on eviction giving referenced keys a second chance. Nothing moves on a hit.
+class ClockStrategy : public EvictionStrategy
+{
+    vector<int> ring;
+    vector<bool> referenced;
+    unordered_map<int, int> position;
+    int hand = 0;
+    int freeSlot = -1;
+
+public:
+    void setCapacity(int capacity) override
+    {
+        capacity = max(0, capacity);
+        ring.reserve(capacity);
+        referenced.reserve(capacity);
+    }
+
+    void keyAdded(int key) override
+    {
+        int slot = freeSlot;
+        if (slot == -1)
+        {
+            slot = (int)ring.size();
+            ring.push_back(key);
+            referenced.push_back(false);
+        }
+        else
+        {
+            ring[slot] = key;
+            referenced[slot] = false;
+            freeSlot = -1;
+        }
+        position[key] = slot;
+    }
+
+    void keyAccessed(int key) override
+    {
+        referenced[position[key]] = true;
+    }
+
+    int evict() override
+    {
+        while (referenced[hand])
+        {
+            referenced[hand] = false;
+            hand = (hand + 1) % ring.size();
+        }
+        int key = ring[hand];
+        position.erase(key);
+        freeSlot = hand;
+        hand = (hand + 1) % ring.size();
+        return key;
+    }
+};
+
+// S3-FIFO eviction strategy: new keys enter a small FIFO (10% of capacity); keys hit
+// while there are promoted to the main FIFO, the rest are evicted early and
+// remembered in a ghost FIFO so that a quick re-insert goes straight to main. Main
+// reinserts keys that were hit since their last pass (up to 3 times).
+class S3FIFOStrategy : public EvictionStrategy
+{
+    deque<int> smallQueue;
+    deque<int> mainQueue;
+    deque<pair<int, long long>> ghostQueue;
+    unordered_map<int, long long> ghost; // key -> ghost insertion sequence
+    unordered_map<int, int> frequency;
+    int smallCapacity = 1;
+    int ghostCapacity = 1;
+    long long ghostSequence = 0;
+
+    void rememberGhost(int key)
+    {
+        ghost[key] = ++ghostSequence;
+        ghostQueue.push_back({key, ghostSequence});
+        while ((int)ghost.size() > ghostCapacity)
+        {
+            auto oldest = ghostQueue.front();
+            ghostQueue.pop_front();
+            auto it = ghost.find(oldest.first);
+            if (it != ghost.end() && it->second == oldest.second)
+                ghost.erase(it);
+        }
+    }
+
+    bool evictFromSmall(int &victim)
+    {
+        while (!smallQueue.empty())
+        {
+            int key = smallQueue.front();
+            smallQueue.pop_front();
+            if (frequency[key] > 0)
+            {
+                frequency[key] = 0;
+                mainQueue.push_back(key);
+                continue;
+            }
+            frequency.erase(key);
+            rememberGhost(key);
+            victim = key;
+            return true;
+        }
+        return false;
+    }
+
+    int evictFromMain()
+    {
+        while (true)
+        {
+            int key = mainQueue.front();
+            mainQueue.pop_front();
+            int &freq = frequency[key];
+            if (freq > 0)
+            {
+                freq--;
+                mainQueue.push_back(key);
+                continue;
+            }
+            frequency.erase(key);
+            return key;
+        }
+    }
+
+public:
+    void setCapacity(int capacity) override
+    {
+        smallCapacity = max(1, capacity / 10);
+        ghostCapacity = max(1, capacity - smallCapacity);
+    }
+
+    void keyAdded(int key) override
+    {
+        frequency[key] = 0;
+        auto it = ghost.find(key);
+        if (it != ghost.end())
+        {
+            ghost.erase(it);
+            mainQueue.push_back(key);
+        }
+        else
+        {
+            smallQueue.push_back(key);
+        }
+    }
+
+    void keyAccessed(int key) override
+    {
+        int &freq = frequency[key];
+        freq = min(freq + 1, 3);
+    }
+
+    int evict() override
+    {
+        int victim;
+        if (((int)smallQueue.size() >= smallCapacity || mainQueue.empty()) && evictFromSmall(victim))
+            return victim;
+        return evictFromMain();
+    }
+};
+
+// Count-min sketch of 4-bit-style saturating counters used by W-TinyLFU to estimate
+// key popularity. All counters are halved every sampleSize increments so that old
+// popularity fades.
+class FrequencySketch
+{
+    vector<uint8_t> counters;
+    uint32_t mask = 0;
+    int additions = 0;
+    int sampleSize = 0;
+
+    uint32_t indexOf(int key, int row) const
+    {
+        uint64_t h = ((uint64_t)(uint32_t)key + row) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+        h *= 0xBF58476D1CE4E5B9ull;
+        return (uint32_t)(h >> 32) & mask;
+    }
+
+public:
+    void setCapacity(int capacity)
+    {
+        capacity = max(0, capacity);
+        uint32_t width = 16;
+        while (width < (uint32_t)capacity * 2)
+            width <<= 1;
+        counters.assign(width * 4, 0);
+        mask = width - 1;
+        sampleSize = max(10, capacity * 10);
+    }
+
+    void increment(int key)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            uint8_t &counter = counters[row * (mask + 1) + indexOf(key, row)];
+            if (counter < 15)
+                counter++;
+        }
+        if (++additions == sampleSize)
+        {
+            for (uint8_t &counter : counters)
+                counter >>= 1;
+            additions /= 2;
+        }
+    }
+
+    int frequency(int key) const
+    {
+        int estimate = 15;
+        for (int row = 0; row < 4; row++)
+            estimate = min(estimate, (int)counters[row * (mask + 1) + indexOf(key, row)]);
+        return estimate;
+    }
+};
+
+// W-TinyLFU eviction strategy: a small LRU window (1%) feeds a segmented LRU main area
+// (probation + 80% protected). When the window overflows, its LRU key only enters
+// the main area if the sketch says it is more popular than the probation victim.
+class WTinyLFUStrategy : public EvictionStrategy
+{
+    enum Segment
+    {
+        WINDOW,
+        PROBATION,
+        PROTECTED
+    };
+
+    struct Entry
+    {
+        Segment segment;
+        list<int>::iterator position;
+    };
+
+    list<int> window;
+    list<int> probation;
+    list<int> protectedSegment;
+    unordered_map<int, Entry> entries;
+    FrequencySketch sketch;
+    int windowCapacity = 1;
+    int protectedCapacity = 1;
+
+    list<int> &segmentList(Segment segment)
+    {
+        if (segment == WINDOW)
+            return window;
+        return segment == PROBATION ? probation : protectedSegment;
+    }
+
+    void moveTo(int, Entry &entry, Segment segment)
+    {
+        list<int> &target = segmentList(segment);
+        target.splice(target.begin(), segmentList(entry.segment), entry.position);
+        entry.segment = segment;
+        entry.position = target.begin();
+    }
+
+    int removeTail(list<int> &segment)
+    {
+        int key = segment.back();
+        segment.pop_back();
+        entries.erase(key);
+        return key;
+    }
+
 public:
-    void evict(list<pair<int, int>> &keys) override
+    void setCapacity(int capacity) override
+    {
+        windowCapacity = max(1, capacity / 100);
+        protectedCapacity = max(1, (capacity - windowCapacity) * 8 / 10);
+        sketch.setCapacity(capacity);
+    }
+
+    void keyAdded(int key) override
+    {
+        sketch.increment(key);
+        window.push_front(key);
+        entries[key] = {WINDOW, window.begin()};
+        // While the cache fills up, window overflow moves to probation without a contest
+        if ((int)window.size() > windowCapacity)
+        {
+            int overflow = window.back();
+            moveTo(overflow, entries[overflow], PROBATION);
+        }
+    }
+
+    void keyAccessed(int key) override
     {
-        if (!keys.empty())
-            keys.pop_back();
+        sketch.increment(key);
+        Entry &entry = entries[key];
+        if (entry.segment == PROBATION)
+        {
+            moveTo(key, entry, PROTECTED);
+            if ((int)protectedSegment.size() > protectedCapacity)
+            {
+                int demoted = protectedSegment.back();
+                moveTo(demoted, entries[demoted], PROBATION);
+            }
+        }
+        else
+        {
+            moveTo(key, entry, entry.segment);
+        }
+    }
+
+    int evict() override
+    {
+        list<int> &mainVictims = probation.empty() ? protectedSegment : probation;
+        if ((int)window.size() < windowCapacity || window.empty())
+            return removeTail(mainVictims);
+        if (mainVictims.empty())
+            return removeTail(window);
+
+        // Window is full: its LRU key competes with the main area's victim for admission
+        int candidate = window.back();
+        int victim = mainVictims.back();
+        if (sketch.frequency(candidate) > sketch.frequency(victim))
+        {
+            moveTo(candidate, entries[candidate], PROBATION);
+            return removeTail(mainVictims);
+        }
+        return removeTail(window);
     }
 };
 
@@ -40,8 +385,12 @@ public:
 class Cache
 {
     int capacity;
+
+protected:
     EvictionStrategy *evictPolicy;
 
+    Cache(int size, EvictionStrategy *strategy) : capacity(size), evictPolicy(strategy) {}
+
 public:
     virtual void put(int key, int value) = 0;
     virtual int get(int key) = 0;
@@ -52,55 +401,920 @@ public:
     }
 };
 
-// Concrete implementation of Cache using LRU strategy
+// Intrusive hook embedded in every TypedCache entry. Compile-time policies link
+// entries through it rather than keeping their own copy of each key.
+template <typename K>
+struct PolicyNode
+{
+    PolicyNode *prev = nullptr;
+    PolicyNode *next = nullptr;
+    bool referenced = false;
+    const K *key = nullptr;
+};
+
+// Circular intrusive list with a sentinel, shared by the compile-time policies
+template <typename K>
+class PolicyList
+{
+protected:
+    PolicyNode<K> head;
+
+    void linkBefore(PolicyNode<K> &position, PolicyNode<K> &node)
+    {
+        node.next = &position;
+        node.prev = position.prev;
+        position.prev->next = &node;
+        position.prev = &node;
+    }
+
+    void unlink(PolicyNode<K> &node)
+    {
+        node.prev->next = node.next;
+        node.next->prev = node.prev;
+    }
+
+public:
+    PolicyList()
+    {
+        head.prev = head.next = &head;
+    }
+    PolicyList(const PolicyList &) = delete;
+    PolicyList &operator=(const PolicyList &) = delete;
+};
+
+// Compile-time LRU policy: most recent entry right after the sentinel
+template <typename K>
+class LRUPolicy : public PolicyList<K>
+{
+    using PolicyList<K>::head;
+
+public:
+    void onInsert(PolicyNode<K> &node)
+    {
+        this->linkBefore(*head.next, node);
+    }
+
+    void onAccess(PolicyNode<K> &node)
+    {
+        this->unlink(node);
+        this->linkBefore(*head.next, node);
+    }
+
+    void onErase(PolicyNode<K> &node)
+    {
+        this->unlink(node);
+    }
+
+    const K &victim()
+    {
+        PolicyNode<K> &node = *head.prev;
+        this->unlink(node);
+        return *node.key;
+    }
+};
+
+// Compile-time CLOCK policy: a hit sets the reference bit, the hand sweeps on eviction
+template <typename K>
+class ClockPolicy : public PolicyList<K>
+{
+    using PolicyList<K>::head;
+    PolicyNode<K> *hand = &head;
+
+    void advance()
+    {
+        hand = hand->next;
+        if (hand == &head)
+            hand = head.next;
+    }
+
+public:
+    void onInsert(PolicyNode<K> &node)
+    {
+        // New entries go just behind the hand, i.e. they are swept last
+        node.referenced = false;
+        this->linkBefore(*hand, node);
+    }
+
+    void onAccess(PolicyNode<K> &node)
+    {
+        node.referenced = true;
+    }
+
+    void onErase(PolicyNode<K> &node)
+    {
+        if (hand == &node)
+            advance();
+        this->unlink(node);
+        if (head.next == &head)
+            hand = &head;
+    }
+
+    const K &victim()
+    {
+        if (hand == &head)
+            hand = head.next;
+        while (hand->referenced)
+        {
+            hand->referenced = false;
+            advance();
+        }
+        PolicyNode<K> &node = *hand;
+        onErase(node);
+        return *node.key;
+    }
+};
+
+// Adapts a runtime EvictionStrategy to the compile-time policy protocol. Strategies
+// have no removal hook, so TypedCache::erase/take are unavailable with this policy.
+class StrategyPolicy
+{
+    EvictionStrategy *strategy;
+    int victimKey = 0;
+
+public:
+    StrategyPolicy(EvictionStrategy *strategy) : strategy(strategy) {}
+
+    void onInsert(PolicyNode<int> &node)
+    {
+        strategy->keyAdded(*node.key);
+    }
+
+    void onAccess(PolicyNode<int> &node)
+    {
+        strategy->keyAccessed(*node.key);
+    }
+
+    const int &victim()
+    {
+        victimKey = strategy->evict();
+        return victimKey;
+    }
+};
+
+// Generic cache with the eviction policy chosen at compile time, so the hit path
+// makes no virtual calls. Values are moved in and out, and get() returns an optional
+// reference instead of a sentinel value.
+template <typename K, typename V, typename Hash = hash<K>, typename Policy = LRUPolicy<K>>
+class TypedCache
+{
+    struct Node : PolicyNode<K>
+    {
+        V value;
+
+        template <typename... Args>
+        Node(Args &&...args) : value(forward<Args>(args)...) {}
+    };
+
+    unordered_map<K, Node, Hash> entries;
+    Policy policy;
+    size_t capacity;
+
+    template <typename KeyArg, typename... Args>
+    V &insertOrAssign(KeyArg &&key, Args &&...args)
+    {
+        auto result = entries.try_emplace(forward<KeyArg>(key), forward<Args>(args)...);
+        Node &node = result.first->second;
+        if (!result.second)
+        {
+            node.value = V(forward<Args>(args)...);
+            policy.onAccess(node);
+            return node.value;
+        }
+        if (entries.size() > capacity)
+            entries.erase(entries.find(policy.victim()));
+        node.key = &result.first->first;
+        policy.onInsert(node);
+        return node.value;
+    }
+
+public:
+    template <typename... PolicyArgs>
+    explicit TypedCache(size_t size, PolicyArgs &&...policyArgs)
+        : policy(forward<PolicyArgs>(policyArgs)...), capacity(size)
+    {
+        entries.reserve(size);
+    }
+
+    optional<reference_wrapper<V>> get(const K &key)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullopt;
+        policy.onAccess(it->second);
+        return it->second.value;
+    }
+
+    void put(const K &key, V value)
+    {
+        if (capacity > 0)
+            insertOrAssign(key, move(value));
+    }
+
+    void put(K &&key, V value)
+    {
+        if (capacity > 0)
+            insertOrAssign(move(key), move(value));
+    }
+
+    // Constructs the value in place from args; returns nullptr for a zero-capacity cache
+    template <typename... Args>
+    V *emplace(const K &key, Args &&...args)
+    {
+        if (capacity == 0)
+            return nullptr;
+        return &insertOrAssign(key, forward<Args>(args)...);
+    }
+
+    // Removes the entry and hands its value back by move
+    optional<V> take(const K &key)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullopt;
+        policy.onErase(it->second);
+        optional<V> value(move(it->second.value));
+        entries.erase(it);
+        return value;
+    }
+
+    bool erase(const K &key)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return false;
+        policy.onErase(it->second);
+        entries.erase(it);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+};
+
+// The original int -> int cache, now a thin wrapper over TypedCache that keeps the
+// runtime-selected EvictionStrategy and the -1 miss sentinel for old call sites
 class LRUCache : public Cache
 {
-    unordered_map<int, list<pair<int, int>>::iterator> cache;
-    list<pair<int, int>> lruOrder;
+    TypedCache<int, int, hash<int>, StrategyPolicy> cache;
 
 public:
-    LRUCache(EvictionStrategy *strategy, int size) : evictPolicy(strategy), capacity(size) {}
+    LRUCache(EvictionStrategy *strategy, int size) : Cache(size, strategy), cache(max(size, 0), strategy)
+    {
+        evictPolicy->setCapacity(size);
+    }
 
     int get(int key) override
     {
-        auto it = cache.find(key);
-        if (it != cache.end())
+        auto value = cache.get(key);
+        return value ? value->get() : -1;
+    }
+
+    void put(int key, int value) override
+    {
+        cache.put(key, value);
+    }
+};
+
+// Cache bounded by total weight (e.g. bytes) rather than entry count, with optional
+// per-entry TTL. Expired entries are dropped lazily when read and proactively, a
+// batch at a time, by a hashed timer wheel that only visits the buckets whose tick
+// has passed, so expiry never needs a full scan.
+template <typename K, typename V, typename Hash = hash<K>, typename Policy = LRUPolicy<K>>
+class BoundedCache
+{
+public:
+    using Clock = chrono::steady_clock;
+    using Weigher = function<size_t(const K &, const V &)>;
+
+    struct Stats
+    {
+        size_t bytes = 0;
+        size_t entries = 0;
+        long long evictions = 0;
+        long long lazyExpirations = 0;
+        long long batchExpirations = 0;
+    };
+
+private:
+    struct Node : PolicyNode<K>
+    {
+        V value;
+        size_t weight = 0;
+        Clock::time_point deadline = Clock::time_point::max();
+        Node *wheelPrev = nullptr;
+        Node *wheelNext = nullptr;
+
+        Node(V &&value) : value(move(value)) {}
+    };
+
+    unordered_map<K, Node, Hash> entries;
+    Policy policy;
+    Weigher weigher;
+    size_t maxWeight;
+    Stats stats;
+
+    vector<Node *> wheel;
+    Clock::duration tick;
+    Clock::time_point epoch;
+    long long wheelCursor = 0; // next tick whose bucket has not been swept
+
+    long long tickOf(Clock::time_point time) const
+    {
+        return (time - epoch) / tick;
+    }
+
+    void schedule(Node &node)
+    {
+        Node *&bucket = wheel[tickOf(node.deadline) & (wheel.size() - 1)];
+        node.wheelPrev = nullptr;
+        node.wheelNext = bucket;
+        if (bucket)
+            bucket->wheelPrev = &node;
+        bucket = &node;
+    }
+
+    void unschedule(Node &node)
+    {
+        if (node.deadline == Clock::time_point::max())
+            return;
+        if (node.wheelPrev)
+            node.wheelPrev->wheelNext = node.wheelNext;
+        else
+            wheel[tickOf(node.deadline) & (wheel.size() - 1)] = node.wheelNext;
+        if (node.wheelNext)
+            node.wheelNext->wheelPrev = node.wheelPrev;
+    }
+
+    void remove(typename unordered_map<K, Node, Hash>::iterator it)
+    {
+        unschedule(it->second);
+        stats.bytes -= it->second.weight;
+        entries.erase(it);
+    }
+
+    void evictOne()
+    {
+        auto it = entries.find(policy.victim());
+        remove(it);
+        stats.evictions++;
+    }
+
+public:
+    BoundedCache(size_t maxBytes, Weigher weigher, Clock::duration tick = chrono::milliseconds(100), size_t wheelSlots = 256)
+        : weigher(move(weigher)), maxWeight(maxBytes), tick(tick), epoch(Clock::now())
+    {
+        size_t slots = 1;
+        while (slots < wheelSlots)
+            slots <<= 1;
+        wheel.assign(slots, nullptr);
+    }
+
+    // ttl of zero means the entry never expires
+    bool put(const K &key, V value, Clock::duration ttl = Clock::duration::zero())
+    {
+        size_t weight = weigher(key, value);
+        // Refused before touching the key, so a rejected update keeps the old value
+        if (weight > maxWeight)
+            return false;
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            policy.onErase(it->second);
+            remove(it);
+        }
+        while (stats.bytes + weight > maxWeight)
+            evictOne();
+
+        auto inserted = entries.try_emplace(key, move(value)).first;
+        Node &node = inserted->second;
+        node.key = &inserted->first;
+        node.weight = weight;
+        stats.bytes += weight;
+        policy.onInsert(node);
+        if (ttl > Clock::duration::zero())
+        {
+            node.deadline = Clock::now() + ttl;
+            schedule(node);
+        }
+        return true;
+    }
+
+    optional<reference_wrapper<V>> get(const K &key)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullopt;
+        Node &node = it->second;
+        if (node.deadline != Clock::time_point::max() && node.deadline <= Clock::now())
+        {
+            policy.onErase(node);
+            remove(it);
+            stats.lazyExpirations++;
+            return nullopt;
+        }
+        policy.onAccess(node);
+        return node.value;
+    }
+
+    // Sweeps the wheel buckets whose tick has passed, expiring at most maxEntries
+    // entries; a bucket cut short is resumed by the next call
+    size_t expireBatch(size_t maxEntries = 1024)
+    {
+        Clock::time_point now = Clock::now();
+        long long currentTick = tickOf(now);
+        size_t expired = 0;
+        // Buckets are reused every wheel.size() ticks, so at most one lap needs sweeping
+        wheelCursor = max(wheelCursor, currentTick - (long long)wheel.size() + 1);
+        for (; wheelCursor <= currentTick; wheelCursor++)
         {
-            auto listIt = it->second;
-            pair<int, int> keyValue = *listIt;
-            lruOrder.erase(listIt);
-            lruOrder.push_front(keyValue);
-            cache[key] = lruOrder.begin();
-            return keyValue.second;
+            Node *node = wheel[wheelCursor & (wheel.size() - 1)];
+            while (node)
+            {
+                Node *next = node->wheelNext;
+                if (node->deadline <= now)
+                {
+                    if (expired == maxEntries)
+                        return expired;
+                    policy.onErase(*node);
+                    remove(entries.find(*node->key));
+                    stats.batchExpirations++;
+                    expired++;
+                }
+                node = next;
+            }
         }
-        return -1;
+        // The current tick may still gain entries that expire later within it
+        wheelCursor = currentTick;
+        return expired;
+    }
+
+    Stats getStats() const
+    {
+        Stats snapshot = stats;
+        snapshot.entries = entries.size();
+        return snapshot;
+    }
+};
+
+// Allocation-free LRU cache. All `capacity` entries live in one contiguous slot
+// array linked by index (prev/next), and keys are located through an
+// open-addressing table of slot indices, so get/put never touch the allocator
+// once the cache is constructed.
+class FlatLRUCache : public Cache
+{
+    static constexpr int NIL = -1;
+
+    struct Slot
+    {
+        int key;
+        int value;
+        int prev;
+        int next;
+    };
+
+    vector<Slot> slots;
+    vector<int> index; // slot index per bucket, NIL when empty
+    int mask;
+    int head = NIL;
+    int tail = NIL;
+    int used = 0;
+    long long evictions = 0;
+
+    int bucketFor(int key) const
+    {
+        uint32_t h = (uint32_t)key * 2654435761u;
+        return (int)((h ^ (h >> 16)) & (uint32_t)mask);
+    }
+
+    int findBucket(int key) const
+    {
+        int bucket = bucketFor(key);
+        while (index[bucket] != NIL && slots[index[bucket]].key != key)
+            bucket = (bucket + 1) & mask;
+        return bucket;
+    }
+
+    // Linear-probing delete with backward shift, so no tombstones pile up
+    void eraseBucket(int bucket)
+    {
+        int hole = bucket;
+        int next = (hole + 1) & mask;
+        while (index[next] != NIL)
+        {
+            int home = bucketFor(slots[index[next]].key);
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                index[hole] = index[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        index[hole] = NIL;
+    }
+
+    void unlink(int slot)
+    {
+        Slot &s = slots[slot];
+        if (s.prev != NIL)
+            slots[s.prev].next = s.next;
+        else
+            head = s.next;
+        if (s.next != NIL)
+            slots[s.next].prev = s.prev;
+        else
+            tail = s.prev;
+    }
+
+    void pushFront(int slot)
+    {
+        slots[slot].prev = NIL;
+        slots[slot].next = head;
+        if (head != NIL)
+            slots[head].prev = slot;
+        head = slot;
+        if (tail == NIL)
+            tail = slot;
+    }
+
+    void moveToFront(int slot)
+    {
+        if (slot == head)
+            return;
+        unlink(slot);
+        pushFront(slot);
+    }
+
+public:
+    FlatLRUCache(int size) : Cache(size, nullptr), slots(max(size, 0))
+    {
+        // Keep the load factor at or below 0.5 so probe chains stay short
+        int buckets = 2;
+        while (buckets < 2 * size)
+            buckets <<= 1;
+        index.assign(buckets, NIL);
+        mask = buckets - 1;
+    }
+
+    int get(int key) override
+    {
+        int slot = index[findBucket(key)];
+        if (slot == NIL)
+            return -1;
+        moveToFront(slot);
+        return slots[slot].value;
     }
 
     void put(int key, int value) override
     {
-        auto it = cache.find(key);
-        if (it != cache.end())
+        if (getCapacity() <= 0)
+            return;
+        int bucket = findBucket(key);
+        int slot = index[bucket];
+        if (slot != NIL)
+        {
+            slots[slot].value = value;
+            moveToFront(slot);
+            return;
+        }
+        if (used == getCapacity())
+        {
+            // Recycle the least recently used slot in place
+            slot = tail;
+            eraseBucket(findBucket(slots[slot].key));
+            unlink(slot);
+            bucket = findBucket(key);
+            evictions++;
+        }
+        else
         {
-            lruOrder.erase(it->second);
-            lruOrder.push_front({key, value});
-            cache[key] = lruOrder.begin();
+            slot = used++;
         }
+        slots[slot].key = key;
+        slots[slot].value = value;
+        index[bucket] = slot;
+        pushFront(slot);
+    }
+
+    int size() const
+    {
+        return used;
+    }
+
+    long long getEvictionCount() const
+    {
+        return evictions;
+    }
+};
+
+struct CacheStats
+{
+    long long hits = 0;
+    long long misses = 0;
+    long long evictions = 0;
+    int size = 0;
+};
+
+// Thread-safe LRU cache. Keys are hash-partitioned across independently locked
+// FlatLRUCache shards, so threads touching different shards never contend.
+class ShardedLRUCache : public Cache
+{
+    // Each shard sits on its own cache line so neighbouring locks do not false-share
+    struct alignas(64) Shard
+    {
+        mutex lock;
+        FlatLRUCache cache;
+        long long hits = 0;
+        long long misses = 0;
+
+        Shard(int size) : cache(size) {}
+    };
+
+    vector<unique_ptr<Shard>> shards;
+
+    Shard &shardFor(int key)
+    {
+        uint64_t h = (uint64_t)(uint32_t)key * 0x9E3779B97F4A7C15ull;
+        return *shards[(h >> 32) % shards.size()];
+    }
+
+public:
+    ShardedLRUCache(int size, int shardCount = (int)thread::hardware_concurrency()) : Cache(size, nullptr)
+    {
+        // No more shards than entries, so that every shard can hold at least one key
+        shardCount = max(1, min(shardCount, size));
+        // Split the total capacity exactly, spreading the remainder over the first shards
+        for (int i = 0; i < shardCount; i++)
+            shards.push_back(make_unique<Shard>(size / shardCount + (i < size % shardCount ? 1 : 0)));
+    }
+
+    int get(int key) override
+    {
+        Shard &shard = shardFor(key);
+        lock_guard<mutex> guard(shard.lock);
+        int value = shard.cache.get(key);
+        if (value == -1)
+            shard.misses++;
         else
+            shard.hits++;
+        return value;
+    }
+
+    void put(int key, int value) override
+    {
+        Shard &shard = shardFor(key);
+        lock_guard<mutex> guard(shard.lock);
+        shard.cache.put(key, value);
+    }
+
+    int getShardCount() const
+    {
+        return (int)shards.size();
+    }
+
+    CacheStats getStats()
+    {
+        CacheStats total;
+        for (auto &shard : shards)
         {
-            if (cache.size() == getCapacity())
+            lock_guard<mutex> guard(shard->lock);
+            total.hits += shard->hits;
+            total.misses += shard->misses;
+            total.evictions += shard->cache.getEvictionCount();
+            total.size += shard->cache.size();
+        }
+        return total;
+    }
+};
+
+// Replays the same random get/put mix against a cache and returns ns/op
+double benchmarkCache(Cache *cache, const vector<int> &keys)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (cache->get(keys[i]) == -1)
+            cache->put(keys[i], (int)i);
+    }
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    return (double)elapsed / keys.size();
+}
+
+void compareLRUImplementations()
+{
+    const int capacity = 10000;
+    const int operations = 2000000;
+    mt19937 rng(7);
+    uniform_int_distribution<int> keyDist(0, capacity * 2);
+    vector<int> keys(operations);
+    for (int &key : keys)
+        key = keyDist(rng);
+
+    LRUStrategy strategy;
+    LRUCache listCache(&strategy, capacity);
+    FlatLRUCache flatCache(capacity);
+
+    cout << "LRUCache     : " << benchmarkCache(&listCache, keys) << " ns/op" << endl;
+    cout << "FlatLRUCache : " << benchmarkCache(&flatCache, keys) << " ns/op" << endl;
+
+    // Same workload with the policy bound at compile time
+    TypedCache<int, int> typedCache(capacity);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (!typedCache.get(keys[i]))
+            typedCache.put(keys[i], (int)i);
+    }
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    cout << "TypedCache   : " << (double)elapsed / keys.size() << " ns/op" << endl;
+}
+
+// Draws keys in [0, n) following a Zipf distribution with exponent s
+class ZipfGenerator
+{
+    vector<double> cdf;
+    uniform_real_distribution<double> uniform{0.0, 1.0};
+
+public:
+    ZipfGenerator(int n, double s) : cdf(n)
+    {
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+            cdf[i] = (sum += 1.0 / pow(i + 1, s));
+        for (double &c : cdf)
+            c /= sum;
+    }
+
+    int next(mt19937 &rng)
+    {
+        return (int)(lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+    }
+};
+
+// Runs every thread's key trace through the cache concurrently and returns Mops/sec
+double measureThroughput(Cache *cache, const vector<vector<int>> &traces)
+{
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (const auto &trace : traces)
+    {
+        workers.emplace_back([cache, &trace]()
+                             {
+            for (int key : trace)
             {
-                auto listIt = --lruOrder.end();
-                cache.erase(listIt->first);
-                evictPolicy->evict(lruOrder);
-            }
-            lruOrder.push_front({key, value});
-            cache[key] = lruOrder.begin();
+                if (cache->get(key) == -1)
+                    cache->put(key, key);
+            } });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return traces.size() * traces[0].size() / seconds / 1e6;
+}
+
+// The pre-sharding setup: one cache behind one global mutex
+class GloballyLockedCache : public Cache
+{
+    mutex lock;
+    FlatLRUCache cache;
+
+public:
+    GloballyLockedCache(int size) : Cache(size, nullptr), cache(size) {}
+
+    int get(int key) override
+    {
+        lock_guard<mutex> guard(lock);
+        return cache.get(key);
+    }
+
+    void put(int key, int value) override
+    {
+        lock_guard<mutex> guard(lock);
+        cache.put(key, value);
+    }
+};
+
+void compareConcurrentCaches()
+{
+    const int capacity = 100000;
+    const int keySpace = 1000000;
+    const int opsPerThread = 200000;
+    ZipfGenerator zipf(keySpace, 0.99);
+
+    cout << "threads  global-mutex(Mops/s)  sharded(Mops/s)  shards  hit-ratio" << endl;
+    for (int threads : {1, 2, 4, 8, 16, 32})
+    {
+        vector<vector<int>> traces(threads, vector<int>(opsPerThread));
+        for (int t = 0; t < threads; t++)
+        {
+            mt19937 rng(t + 1);
+            for (int &key : traces[t])
+                key = zipf.next(rng);
         }
+
+        GloballyLockedCache globalCache(capacity);
+        ShardedLRUCache shardedCache(capacity, 64); // fixed, so the table does not depend on the host's core count
+        double global = measureThroughput(&globalCache, traces);
+        double sharded = measureThroughput(&shardedCache, traces);
+        CacheStats stats = shardedCache.getStats();
+        cout << setw(7) << threads << setw(22) << global << setw(17) << sharded << setw(8)
+             << shardedCache.getShardCount() << setw(11) << (double)stats.hits / (stats.hits + stats.misses) << endl;
     }
+}
+
+// Trace replay tool: runs a key trace through a cache (get, then put on miss) and
+// reports hit ratio and throughput
+struct ReplayResult
+{
+    double hitRatio;
+    double opsPerSecond;
 };
 
-int main()
+ReplayResult replayTrace(Cache *cache, const vector<int> &trace)
+{
+    long long hits = 0;
+    auto start = chrono::steady_clock::now();
+    for (int key : trace)
+    {
+        if (cache->get(key) != -1)
+            hits++;
+        else
+            cache->put(key, key);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return {(double)hits / trace.size(), trace.size() / seconds};
+}
+
+vector<int> zipfTrace(int keySpace, int length, double skew)
+{
+    ZipfGenerator zipf(keySpace, skew);
+    mt19937 rng(42);
+    vector<int> trace(length);
+    for (int &key : trace)
+        key = zipf.next(rng);
+    return trace;
+}
+
+// A Zipf working set interrupted by long one-off sequential scans
+vector<int> scanHeavyTrace(int keySpace, int length, int scanLength)
 {
+    ZipfGenerator zipf(keySpace, 0.9);
+    mt19937 rng(43);
+    vector<int> trace;
+    int nextScanKey = keySpace;
+    while ((int)trace.size() < length)
+    {
+        for (int i = 0; i < scanLength && (int)trace.size() < length; i++)
+            trace.push_back(zipf.next(rng));
+        for (int i = 0; i < scanLength && (int)trace.size() < length; i++)
+            trace.push_back(nextScanKey++);
+    }
+    return trace;
+}
+
+void replayAllPolicies(const string &traceName, const vector<int> &trace, int capacity)
+{
+    vector<pair<string, function<EvictionStrategy *()>>> policies = {
+        {"LRU", []()
+         { return new LRUStrategy(); }},
+        {"CLOCK", []()
+         { return new ClockStrategy(); }},
+        {"S3-FIFO", []()
+         { return new S3FIFOStrategy(); }},
+        {"W-TinyLFU", []()
+         { return new WTinyLFUStrategy(); }},
+    };
+
+    cout << traceName << " (" << trace.size() << " requests, capacity " << capacity << ")" << endl;
+    for (auto &policy : policies)
+    {
+        unique_ptr<EvictionStrategy> strategy(policy.second());
+        LRUCache cache(strategy.get(), capacity);
+        ReplayResult result = replayTrace(&cache, trace);
+        cout << "  " << left << setw(10) << policy.first << right << " hit-ratio " << fixed << setprecision(4)
+             << result.hitRatio << "  " << setprecision(2) << result.opsPerSecond / 1e6 << " Mops/s" << endl;
+        cout.unsetf(ios::fixed);
+        cout << setprecision(6);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // `LRUCache <trace-file> [capacity]` replays a whitespace-separated key trace
+    if (argc > 1)
+    {
+        ifstream in(argv[1]);
+        vector<int> trace{istream_iterator<int>(in), istream_iterator<int>()};
+        replayAllPolicies(argv[1], trace, argc > 2 ? atoi(argv[2]) : 10000);
+        return 0;
+    }
+
     // Usage of the LRUCache with LRUEvictionStrategy
     EvictionStrategy *strategy = new LRUStrategy();
     LRUCache *lrucache = new LRUCache(strategy, 3);
@@ -113,6 +1327,52 @@ int main()
 
     delete lrucache;
     delete strategy;
+
+    // Same sequence against the allocation-free variant
+    FlatLRUCache flatcache(3);
+    flatcache.put(5, 6);
+    flatcache.put(3, 1);
+    cout << flatcache.get(5) << endl;
+    flatcache.put(1, 2);
+    cout << flatcache.get(1) << endl;
+    flatcache.put(4, 4);
+    cout << flatcache.get(3) << endl;
+
+    // String keys and large values are moved in and out without copies
+    TypedCache<string, vector<char>, hash<string>, ClockPolicy<string>> blobCache(2);
+    blobCache.put("avatar:1", vector<char>(4096, 'a'));
+    blobCache.put("avatar:2", vector<char>(8192, 'b'));
+    if (auto blob = blobCache.get("avatar:1"))
+        cout << "avatar:1 -> " << blob->get().size() << " bytes" << endl;
+    blobCache.put("avatar:3", vector<char>(2048, 'c'));
+    cout << "avatar:2 cached: " << (blobCache.get("avatar:2") ? "yes" : "no") << endl;
+    optional<vector<char>> taken = blobCache.take("avatar:3");
+    cout << "took avatar:3 (" << taken->size() << " bytes), " << blobCache.size() << " entries left" << endl;
+
+    // Byte-bounded cache whose entries expire after a TTL
+    BoundedCache<string, string> sessionCache(100, [](const string &key, const string &value)
+                                              { return key.size() + value.size(); },
+                                              chrono::milliseconds(10));
+    sessionCache.put("session:1", "alice-token", chrono::milliseconds(30));
+    sessionCache.put("session:2", "bob-token", chrono::milliseconds(30));
+    sessionCache.put("session:3", "carol", chrono::milliseconds(30));
+    sessionCache.put("config", "dark-mode");
+    sessionCache.put("blob:1", string(30, 'x'));
+    this_thread::sleep_for(chrono::milliseconds(50));
+    cout << "session:2 after ttl: " << (sessionCache.get("session:2") ? "hit" : "expired") << endl;
+    sessionCache.expireBatch();
+    auto sessionStats = sessionCache.getStats();
+    cout << "bytes=" << sessionStats.bytes << " entries=" << sessionStats.entries << " evictions=" << sessionStats.evictions
+         << " lazy-expired=" << sessionStats.lazyExpirations << " batch-expired=" << sessionStats.batchExpirations << endl;
+    bool oversizedAccepted = sessionCache.put("config", string(200, 'y'));
+    cout << "oversized config update " << (oversizedAccepted ? "accepted" : "rejected") << ", config is "
+         << (sessionCache.get("config") ? sessionCache.get("config")->get() : "gone") << endl;
+
+    compareLRUImplementations();
+    compareConcurrentCaches();
+
+    replayAllPolicies("zipf-0.99", zipfTrace(100000, 1000000, 0.99), 5000);
+    replayAllPolicies("scan-heavy", scanHeavyTrace(100000, 1000000, 20000), 5000);
 }
 
 /*
@@ -124,4 +1384,32 @@ abstract strategy interface, and LRUStrategy is one of its concrete implementati
 This pattern allows for the easy addition of new eviction strategies without modifying
 existing code, promoting flexibility and maintainability.
 
+Strategies own their own metadata: the cache only reports insertions (keyAdded) and
+hits (keyAccessed) and asks for a victim key (evict) when full. This lets policies
+that do not keep a recency list live behind the same interface:
+- ClockStrategy keeps a ring with reference bits, so a hit is a single bit write.
+- S3FIFOStrategy filters one-hit wonders through a small FIFO with a ghost queue.
+- WTinyLFUStrategy admits keys into its segmented LRU using a count-min sketch.
+replayAllPolicies() compares hit ratio and throughput of every policy on a trace.
+
+TypedCache<K, V, Hash, Policy> is the generic version. The policy is a template
+parameter whose hooks are embedded in each entry (PolicyNode), so the hit path is
+statically dispatched and keys are stored once. LRUCache keeps its old signature by
+plugging its runtime EvictionStrategy into TypedCache through StrategyPolicy.
+
+BoundedCache uses the same policies but measures capacity with a weigher callback
+(e.g. bytes per entry) and supports per-entry TTL. Deadlines are kept in a hashed
+timer wheel: get() drops an expired entry lazily, and expireBatch() sweeps only the
+wheel buckets whose tick has elapsed, in bounded batches.
+
+FlatLRUCache implements the same Cache interface without a list or node-based map:
+entries sit in a preallocated slot array threaded into an index-linked LRU list, and
+an open-addressing table maps keys to slots. A miss on a full cache reuses the tail
+slot in place, so the steady state performs no allocations and stays cache-friendly.
+
+ShardedLRUCache makes the cache safe for concurrent use without a single global lock.
+Keys are hashed to one of N FlatLRUCache shards (N defaults to the number of hardware
+threads), each guarded by its own mutex and holding an exact share of the capacity.
+Hit/miss/eviction counters are kept per shard and summed on demand by getStats().
+
 */
\ No newline at end of file
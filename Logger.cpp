@@ -14,15 +14,39 @@ Core Use Cases
 ##########################################################################*/
 
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
 using namespace std;
 
-// Enum for log levels
+// Enum for log levels, ordered by severity
 enum class LogLevel
 {
+    DEBUG,
     INFO,
     WARNING,
-    ERROR,
-    DEBUG
+    ERROR
+};
+
+// Levels below this are compiled out of the LOG_* macros entirely, e.g. build with
+// -DLOG_COMPILE_MIN_LEVEL=1 to strip DEBUG logging from release binaries
+#ifndef LOG_COMPILE_MIN_LEVEL
+#define LOG_COMPILE_MIN_LEVEL 0
+#endif
+
+constexpr LogLevel COMPILE_TIME_MIN_LEVEL = static_cast<LogLevel>(LOG_COMPILE_MIN_LEVEL);
+
+constexpr bool isCompiledIn(LogLevel level)
+{
+    return level >= COMPILE_TIME_MIN_LEVEL;
+}
+
+// Output format of a log line
+enum class LogFormat
+{
+    TEXT, // [2024-01-01 12:00:00.123] [INFO] message key=value
+    JSON  // {"ts":"2024-01-01 12:00:00.123","level":"INFO","msg":"message","key":"value"}
 };
 
 // Abstract Log Strategy
@@ -31,6 +55,22 @@ class LogStrategy
 public:
     virtual ~LogStrategy() = default;
     virtual void log(string &message) = 0;
+
+    // Pushes out anything the strategy has buffered
+    virtual void flush() {}
+
+    // Writes one or more already formatted, newline-terminated lines. Strategies that
+    // can write raw bytes override this to avoid building a string per line.
+    virtual void write(string_view lines)
+    {
+        while (!lines.empty())
+        {
+            size_t end = lines.find('\n');
+            string line(lines.substr(0, end));
+            log(line);
+            lines.remove_prefix(end == string_view::npos ? lines.size() : end + 1);
+        }
+    }
 };
 
 // Console Log Strategy
@@ -41,52 +81,388 @@ public:
     {
         cout << message << endl;
     }
+
+    void write(string_view lines) override
+    {
+        cout.write(lines.data(), lines.size());
+        cout.flush();
+    }
+};
+
+// When a file sink calls fsync
+enum class FsyncPolicy
+{
+    NEVER,       // leave it to the OS
+    ON_ROTATE,   // before a file is closed for rotation
+    EVERY_FLUSH  // after every write of the buffer to the file
 };
 
-// File Log Strategy
+struct FileLogOptions
+{
+    size_t bufferBytes = 1 << 20;                  // 0 writes every line through immediately
+    chrono::milliseconds flushInterval{1000};      // buffered lines older than this are written on the next log
+    size_t maxFileBytes = 0;                       // rotate once the file reaches this size; 0 disables
+    chrono::seconds rotateInterval{0};             // rotate files older than this; 0 disables
+    int maxBackups = 5;                            // keeps filename.1 .. filename.N
+    FsyncPolicy fsyncPolicy = FsyncPolicy::ON_ROTATE;
+    bool compressOnRotate = false;                 // gzip rotated files in the background (filename.1.gz ...)
+};
+
+// File Log Strategy. Lines are collected in a user-space buffer and written with one
+// write() per buffer instead of a flush per line; the file is rotated by size/age.
 class FileLogStrategy : public LogStrategy
 {
-    ofstream file;
+    string filename;
+    FileLogOptions options;
+    int fd = -1;
+    size_t fileBytes = 0;
+    chrono::steady_clock::time_point openedAt;
+    chrono::steady_clock::time_point oldestBuffered;
+    vector<char> buffer;
+    size_t buffered = 0;
+    long long rotations = 0;
+    thread compressor;
+    mutex fileMutex;
+
+    void openFile()
+    {
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        fileBytes = 0;
+        if (fd >= 0)
+            fileBytes = (size_t)lseek(fd, 0, SEEK_END);
+        openedAt = chrono::steady_clock::now();
+    }
+
+    void writeFully(const char *data, size_t size)
+    {
+        while (size > 0 && fd >= 0)
+        {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            data += written;
+            size -= written;
+            fileBytes += written;
+        }
+    }
+
+    void flushBuffer()
+    {
+        if (buffered == 0)
+            return;
+        writeFully(buffer.data(), buffered);
+        buffered = 0;
+        if (options.fsyncPolicy == FsyncPolicy::EVERY_FLUSH && fd >= 0)
+            ::fsync(fd);
+    }
+
+    string backupName(int index) const
+    {
+        return filename + "." + to_string(index);
+    }
+
+    // Runs gzip without a shell. If it fails the plain file is kept and any
+    // partial .gz removed, so the backup is never lost.
+    static void compressFile(const string &path)
+    {
+        const char *argv[] = {"gzip", "-f", "--", path.c_str(), nullptr};
+        pid_t pid;
+        int status = 0;
+        bool compressed = posix_spawnp(&pid, "gzip", nullptr, nullptr, const_cast<char *const *>(argv), environ) == 0 &&
+                          waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (!compressed && ::access(path.c_str(), F_OK) == 0)
+            ::remove((path + ".gz").c_str());
+    }
+
+    void waitForCompressor()
+    {
+        if (compressor.joinable())
+            compressor.join();
+    }
+
+    bool rotationDue() const
+    {
+        if (options.maxFileBytes > 0 && fileBytes + buffered >= options.maxFileBytes)
+            return true;
+        return options.rotateInterval.count() > 0 && chrono::steady_clock::now() - openedAt >= options.rotateInterval;
+    }
+
+    void rotate()
+    {
+        flushBuffer();
+        if (fd >= 0)
+        {
+            if (options.fsyncPolicy != FsyncPolicy::NEVER)
+                ::fsync(fd);
+            ::close(fd);
+        }
+        // The previous backup must be compressed (or left plain) before it is renamed.
+        // A backup may exist under either name, so both are shifted.
+        waitForCompressor();
+        ::remove(backupName(options.maxBackups).c_str());
+        ::remove((backupName(options.maxBackups) + ".gz").c_str());
+        for (int i = options.maxBackups - 1; i >= 1; i--)
+        {
+            ::rename(backupName(i).c_str(), backupName(i + 1).c_str());
+            ::rename((backupName(i) + ".gz").c_str(), (backupName(i + 1) + ".gz").c_str());
+        }
+        string rotated = backupName(1);
+        ::rename(filename.c_str(), rotated.c_str());
+        if (options.compressOnRotate)
+            compressor = thread(compressFile, rotated);
+        rotations++;
+        openFile();
+    }
+
+    void append(string_view lines)
+    {
+        if (buffered == 0)
+            oldestBuffered = chrono::steady_clock::now();
+        if (buffered + lines.size() > buffer.size())
+            flushBuffer();
+        if (lines.size() > buffer.size())
+            writeFully(lines.data(), lines.size());
+        else
+        {
+            memcpy(buffer.data() + buffered, lines.data(), lines.size());
+            buffered += lines.size();
+        }
+        if (buffered > 0 && chrono::steady_clock::now() - oldestBuffered >= options.flushInterval)
+            flushBuffer();
+        if (rotationDue())
+            rotate();
+    }
 
 public:
-    FileLogStrategy(string &filename)
+    FileLogStrategy(const string &filename, FileLogOptions fileOptions = FileLogOptions())
+        : filename(filename), options(fileOptions), buffer(fileOptions.bufferBytes)
     {
-        file.open(filename, ios::app);
+        openFile();
     }
     ~FileLogStrategy()
     {
-        if (file.is_open())
+        waitForCompressor();
+        flushBuffer();
+        if (fd >= 0)
         {
-            file.close();
+            if (options.fsyncPolicy != FsyncPolicy::NEVER)
+                ::fsync(fd);
+            ::close(fd);
         }
     }
     void log(string &message) override
     {
-        if (file.is_open())
-        {
-            file << message << endl;
-        }
+        lock_guard<mutex> lock(fileMutex);
+        message.push_back('\n');
+        append(message);
+        message.pop_back();
+    }
+
+    void write(string_view lines) override
+    {
+        lock_guard<mutex> lock(fileMutex);
+        append(lines);
+    }
+
+    void flush() override
+    {
+        lock_guard<mutex> lock(fileMutex);
+        flushBuffer();
+    }
+
+    long long getRotationCount()
+    {
+        lock_guard<mutex> lock(fileMutex);
+        return rotations;
     }
 };
 
-// Logger Singleton
-class Logger
+// A structured key/value attached to a log call. Both sides are views, so the
+// caller's strings must outlive the log() call (they are copied while formatting).
+struct LogField
 {
-private:
-    LogStrategy *strategy;
-    static Logger *instance;
+    string_view key;
+    string_view text;
+    long long number = 0;
+    bool isNumber = false;
+
+    LogField(string_view key, string_view value) : key(key), text(value) {}
+    LogField(string_view key, const char *value) : key(key), text(value) {}
+    LogField(string_view key, const string &value) : key(key), text(value) {}
+    LogField(string_view key, long long value) : key(key), number(value), isNumber(true) {}
+    LogField(string_view key, int value) : key(key), number(value), isNumber(true) {}
+};
 
-    Logger() : strategy(nullptr) {}
+// Appends into caller-provided storage, cutting text that does not fit. The cut is
+// remembered so the formatter can mark the line, and the end of the buffer can be
+// held back for a closing suffix.
+class LogBuffer
+{
+    char *data;
+    size_t capacity;
+    size_t limit;
+    size_t length = 0;
+    bool truncated = false;
+
+public:
+    LogBuffer(char *storage, size_t size) : data(storage), capacity(size), limit(size) {}
 
-    string getCurrentTimestamp() const
+    void append(string_view text)
     {
-        std::time_t now = std::time(nullptr);
-        char buf[20];
-        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
-        return std::string(buf);
+        size_t n = min(text.size(), limit - length);
+        memcpy(data + length, text.data(), n);
+        length += n;
+        if (n < text.size())
+            truncated = true;
+    }
+
+    void append(char c)
+    {
+        if (length < limit)
+            data[length++] = c;
+        else
+            truncated = true;
+    }
+
+    // Keeps the last `bytes` of the buffer free until releaseTail()
+    void reserveTail(size_t bytes)
+    {
+        limit = max(length, capacity - min(bytes, capacity));
+    }
+
+    void releaseTail()
+    {
+        limit = capacity;
+    }
+
+    bool wasTruncated() const
+    {
+        return truncated;
+    }
+
+    // Drops everything after the first `size` bytes
+    void resize(size_t size)
+    {
+        length = min(length, size);
+    }
+
+    void appendNumber(long long value)
+    {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        append(string_view(digits, result.ptr - digits));
+    }
+
+    // Escape sequences and UTF-8 characters are never split: when the next one does
+    // not fit, the text stops before it
+    void appendJsonEscaped(string_view text)
+    {
+        static const char hex[] = "0123456789abcdef";
+        size_t i = 0;
+        while (i < text.size())
+        {
+            // Runs of characters that need no escaping are copied in one go
+            size_t run = i;
+            while (run < text.size() && text[run] != '"' && text[run] != '\\' && (unsigned char)text[run] >= 0x20)
+                run++;
+            if (run > i)
+            {
+                size_t n = min(run - i, limit - length);
+                if (n < run - i)
+                {
+                    // Back off to the start of a UTF-8 character
+                    while (n > 0 && ((unsigned char)text[i + n] & 0xC0) == 0x80)
+                        n--;
+                    memcpy(data + length, text.data() + i, n);
+                    length += n;
+                    truncated = true;
+                    return;
+                }
+                memcpy(data + length, text.data() + i, n);
+                length += n;
+                i = run;
+                continue;
+            }
+            char c = text[i++];
+            char escaped[6] = {'\\', c};
+            size_t n = 2;
+            if (c != '"' && c != '\\')
+            {
+                memcpy(escaped, "\\u00", 4);
+                escaped[4] = hex[(c >> 4) & 0xF];
+                escaped[5] = hex[c & 0xF];
+                n = 6;
+            }
+            if (length + n > limit)
+            {
+                truncated = true;
+                return;
+            }
+            memcpy(data + length, escaped, n);
+            length += n;
+        }
+    }
+
+    // Terminates the line, overwriting the last byte if the buffer is full
+    void endLine()
+    {
+        if (length == capacity)
+            length--;
+        data[length++] = '\n';
+    }
+
+    size_t size() const
+    {
+        return length;
     }
 
-    string getLogLevelString(LogLevel level) const
+    size_t remaining() const
+    {
+        return capacity - length;
+    }
+
+    void clear()
+    {
+        length = 0;
+    }
+
+    string_view view() const
+    {
+        return string_view(data, length);
+    }
+
+    // Appends one argument of a variadic log call
+    template <typename T>
+    void appendValue(const T &value)
+    {
+        if constexpr (is_same_v<T, bool>)
+            append(value ? string_view("true") : string_view("false"));
+        else if constexpr (is_same_v<T, char>)
+            append(value);
+        else if constexpr (is_integral_v<T>)
+            appendNumber((long long)value);
+        else if constexpr (is_floating_point_v<T>)
+        {
+            char digits[32];
+            auto result = to_chars(digits, digits + sizeof(digits), (double)value);
+            append(string_view(digits, result.ptr - digits));
+        }
+        else
+            append(string_view(value));
+    }
+};
+
+// Allocation-free formatting. A line is split into a body (message + fields), which
+// the calling thread renders, and a prefix (timestamp + level) added when the line
+// is written, so the async writer can add it later.
+class LogFormatter
+{
+public:
+    static string_view levelName(LogLevel level)
     {
         switch (level)
         {
@@ -103,32 +479,644 @@ private:
         }
     }
 
+    static long long nowMillis()
+    {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // "YYYY-MM-DD HH:MM:SS.mmm". localtime/strftime run once per second per thread;
+    // other calls only rewrite the milliseconds.
+    static void appendTimestamp(LogBuffer &out, long long epochMillis)
+    {
+        thread_local long long cachedSecond = -1;
+        thread_local char cached[23];
+        long long second = epochMillis / 1000;
+        if (second != cachedSecond)
+        {
+            time_t seconds = (time_t)second;
+            tm local;
+            localtime_r(&seconds, &local);
+            strftime(cached, 20, "%Y-%m-%d %H:%M:%S", &local);
+            cached[19] = '.';
+            cachedSecond = second;
+        }
+        int millis = (int)(epochMillis % 1000);
+        cached[20] = (char)('0' + millis / 100);
+        cached[21] = (char)('0' + millis / 10 % 10);
+        cached[22] = (char)('0' + millis % 10);
+        out.append(string_view(cached, sizeof(cached)));
+    }
+
+    // A body that does not fit is cut and marked: in JSON the message is shortened
+    // before its closing quote, fields that do not fit whole are left out and
+    // "truncated":true is added; in text the line ends with " [truncated]"
+    static void appendBody(LogBuffer &out, LogFormat format, string_view message, initializer_list<LogField> fields)
+    {
+        static constexpr string_view JSON_MARK = ",\"truncated\":true";
+        static constexpr string_view TEXT_MARK = " [truncated]";
+        if (format == LogFormat::JSON)
+        {
+            out.reserveTail(1 + JSON_MARK.size());
+            out.append("\"msg\":\"");
+            out.appendJsonEscaped(message);
+            out.reserveTail(JSON_MARK.size());
+            out.append('"');
+            for (const LogField &field : fields)
+            {
+                if (out.wasTruncated())
+                    break;
+                size_t fieldStart = out.size();
+                out.append(",\"");
+                out.appendJsonEscaped(field.key);
+                out.append("\":");
+                if (field.isNumber)
+                    out.appendNumber(field.number);
+                else
+                {
+                    out.append('"');
+                    out.appendJsonEscaped(field.text);
+                    out.append('"');
+                }
+                if (out.wasTruncated())
+                    out.resize(fieldStart);
+            }
+            out.releaseTail();
+            if (out.wasTruncated())
+                out.append(JSON_MARK);
+            return;
+        }
+        out.reserveTail(TEXT_MARK.size());
+        out.append(message);
+        for (const LogField &field : fields)
+        {
+            out.append(' ');
+            out.append(field.key);
+            out.append('=');
+            if (field.isNumber)
+                out.appendNumber(field.number);
+            else
+                out.append(field.text);
+        }
+        out.releaseTail();
+        if (out.wasTruncated())
+            out.append(TEXT_MARK);
+    }
+
+    static void appendLine(LogBuffer &out, LogFormat format, LogLevel level, long long epochMillis, string_view body)
+    {
+        if (format == LogFormat::JSON)
+        {
+            out.append("{\"ts\":\"");
+            appendTimestamp(out, epochMillis);
+            out.append("\",\"level\":\"");
+            out.append(levelName(level));
+            out.append("\",");
+            out.append(body);
+            out.append('}');
+        }
+        else
+        {
+            out.append('[');
+            appendTimestamp(out, epochMillis);
+            out.append("] [");
+            out.append(levelName(level));
+            out.append("] ");
+            out.append(body);
+        }
+        out.endLine();
+    }
+};
+
+// What an async logger does when its ring buffer is full
+enum class OverflowPolicy
+{
+    BLOCK,       // caller waits for the writer to free a slot
+    DROP_NEWEST, // the message being logged is discarded
+    DROP_OLDEST  // the oldest queued message is discarded to make room
+};
+
+// A log call captured for the async writer. The formatted body is copied into a
+// fixed inline buffer so enqueueing never allocates; MAX_TEXT is the body limit in
+// both modes, so a message is cut at the same place whether or not logging is async.
+struct LogRecord
+{
+    static constexpr size_t MAX_TEXT = 512;
+
+    LogLevel level;
+    long long epochMillis;
+    uint16_t length;
+    char text[MAX_TEXT];
+};
+
+// Bounded lock-free ring buffer of preallocated LogRecords (Vyukov's sequence-number
+// scheme). Any number of threads may push; the writer thread pops. Producers may
+// also pop, which is how DROP_OLDEST makes room.
+class LogRingBuffer
+{
+    struct Cell
+    {
+        atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueuePos{0};
+    alignas(64) atomic<size_t> dequeuePos{0};
+
 public:
-    static Logger *getInstance()
+    LogRingBuffer(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    bool tryPush(LogLevel level, long long epochMillis, string_view body)
+    {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = enqueuePos.load(memory_order_relaxed);
+        }
+        cell->record.level = level;
+        cell->record.epochMillis = epochMillis;
+        cell->record.length = (uint16_t)min(body.size(), LogRecord::MAX_TEXT);
+        memcpy(cell->record.text, body.data(), cell->record.length);
+        cell->sequence.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    bool tryPop(LogRecord &record)
     {
-        if (!instance)
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        Cell *cell;
+        while (true)
         {
-            instance = new Logger();
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = dequeuePos.load(memory_order_relaxed);
         }
-        return instance;
+        record = cell->record;
+        cell->sequence.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+};
+
+// One destination of the logger with its own level filter
+struct LogSink
+{
+    LogStrategy *strategy;
+    LogLevel minLevel;
+};
+
+// Logger Singleton
+class Logger
+{
+private:
+    // Copy-on-write sink list: log() reads a snapshot, add/remove publish a new one
+    shared_ptr<const vector<LogSink>> sinks = make_shared<vector<LogSink>>();
+    mutex sinksMutex;
+    atomic<LogLevel> minLevel{LogLevel::DEBUG};
+
+    // Async mode state. log() announces itself in activeProducers before loading
+    // ringBuffer, so disableAsync() can unpublish the ring and wait for callers
+    // still pushing into it before the final drain and the delete.
+    atomic<LogRingBuffer *> ringBuffer{nullptr};
+    alignas(64) atomic<int> activeProducers{0};
+    mutex asyncMutex;
+    OverflowPolicy overflowPolicy = OverflowPolicy::BLOCK;
+    thread writer;
+    atomic<bool> stopWriter{false};
+    atomic<bool> writerWaiting{false};
+    mutex writerMutex;
+    condition_variable writerCV;
+    atomic<long long> droppedNewest{0};
+    atomic<long long> droppedOldest{0};
+
+    static constexpr size_t LINE_BUFFER_SIZE = 4096;
+
+    atomic<LogFormat> format{LogFormat::TEXT};
+
+    Logger() {}
+
+    shared_ptr<const vector<LogSink>> currentSinks() const
+    {
+        return atomic_load(&sinks);
+    }
+
+    ~Logger()
+    {
+        disableAsync();
+    }
+
+public:
+    // Function-local static: initialisation is thread-safe and later calls take no lock
+    static Logger *getInstance()
+    {
+        static Logger instance;
+        return &instance;
+    }
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    void setMinLevel(LogLevel level)
+    {
+        minLevel.store(level, memory_order_relaxed);
     }
 
+    bool isEnabled(LogLevel level) const
+    {
+        return isCompiledIn(level) && level >= minLevel.load(memory_order_relaxed);
+    }
+
+    // Replaces every sink with this one strategy (nullptr removes all sinks)
     void setStrategy(LogStrategy *newStrategy)
     {
-        strategy = newStrategy;
+        lock_guard<mutex> lock(sinksMutex);
+        auto updated = make_shared<vector<LogSink>>();
+        if (newStrategy)
+            updated->push_back({newStrategy, LogLevel::DEBUG});
+        atomic_store(&sinks, shared_ptr<const vector<LogSink>>(updated));
+    }
+
+    // Fans every message at or above minLevel out to this strategy as well
+    void addSink(LogStrategy *sinkStrategy, LogLevel sinkMinLevel = LogLevel::DEBUG)
+    {
+        lock_guard<mutex> lock(sinksMutex);
+        auto updated = make_shared<vector<LogSink>>(*sinks);
+        updated->push_back({sinkStrategy, sinkMinLevel});
+        atomic_store(&sinks, shared_ptr<const vector<LogSink>>(updated));
+    }
+
+    void removeSink(LogStrategy *sinkStrategy)
+    {
+        lock_guard<mutex> lock(sinksMutex);
+        auto updated = make_shared<vector<LogSink>>(*sinks);
+        updated->erase(remove_if(updated->begin(), updated->end(), [sinkStrategy](const LogSink &sink)
+                                 { return sink.strategy == sinkStrategy; }),
+                       updated->end());
+        atomic_store(&sinks, shared_ptr<const vector<LogSink>>(updated));
+    }
+
+    void flush()
+    {
+        for (const LogSink &sink : *currentSinks())
+            sink.strategy->flush();
+    }
+
+    void setFormat(LogFormat newFormat)
+    {
+        format = newFormat;
+    }
+
+    void log(const string &message, LogLevel level)
+    {
+        log(level, message);
+    }
+
+    // Formats into a thread-local buffer; no heap allocation per message
+    void log(LogLevel level, string_view message, initializer_list<LogField> fields = {})
+    {
+        if (!isEnabled(level))
+            return;
+        if (ringBuffer.load(memory_order_relaxed) && logAsync(level, message, fields))
+            return;
+        char bodyStorage[LogRecord::MAX_TEXT];
+        LogBuffer body(bodyStorage, sizeof(bodyStorage));
+        LogFormatter::appendBody(body, format, message, fields);
+        long long now = LogFormatter::nowMillis();
+        thread_local char lineStorage[LINE_BUFFER_SIZE + 64];
+        LogBuffer line(lineStorage, sizeof(lineStorage));
+        auto snapshot = currentSinks();
+        for (const LogSink &sink : *snapshot)
+        {
+            if (level < sink.minLevel)
+                continue;
+            if (line.size() == 0)
+                LogFormatter::appendLine(line, format, level, now, body.view());
+            sink.strategy->write(line.view());
+        }
+    }
+
+    // Concatenates the arguments into the message; prefer the LOG_* macros, which
+    // skip evaluating the arguments altogether when the level is disabled
+    template <typename... Args>
+    void logArgs(LogLevel level, const Args &...args)
+    {
+        if (!isEnabled(level))
+            return;
+        thread_local char messageStorage[LINE_BUFFER_SIZE];
+        LogBuffer message(messageStorage, sizeof(messageStorage));
+        (message.appendValue(args), ...);
+        log(level, message.view());
+    }
+
+    // Compile-time level variant: calls below COMPILE_TIME_MIN_LEVEL compile to nothing
+    template <LogLevel level, typename... Args>
+    void logAt(const Args &...args)
+    {
+        if constexpr (isCompiledIn(level))
+            logArgs(level, args...);
+    }
+
+    // Switches to async mode: log() only copies the message into a ring buffer of
+    // `capacity` records and a writer thread formats and writes them in batches.
+    // Safe to call while other threads are logging.
+    void enableAsync(size_t capacity = 8192, OverflowPolicy policy = OverflowPolicy::BLOCK)
+    {
+        lock_guard<mutex> lock(asyncMutex);
+        if (ringBuffer.load())
+            return;
+        LogRingBuffer *ring = new LogRingBuffer(capacity);
+        overflowPolicy = policy;
+        stopWriter = false;
+        writer = thread(&Logger::writerLoop, this, ring);
+        ringBuffer.store(ring);
+    }
+
+    // Returns to synchronous logging. New calls stop using the ring at once; calls
+    // already pushing into it finish first, then the writer drains everything
+    // queued, so no record is lost. Safe to call while other threads are logging.
+    void disableAsync()
+    {
+        lock_guard<mutex> lock(asyncMutex);
+        LogRingBuffer *ring = ringBuffer.exchange(nullptr);
+        if (!ring)
+            return;
+        while (activeProducers.load() != 0)
+            this_thread::yield();
+        stopWriter = true;
+        {
+            lock_guard<mutex> lock(writerMutex);
+            writerCV.notify_one();
+        }
+        writer.join();
+        delete ring;
+    }
+
+    long long getDroppedCount() const
+    {
+        return droppedNewest + droppedOldest;
+    }
+
+    long long getDroppedNewestCount() const
+    {
+        return droppedNewest;
+    }
+
+    long long getDroppedOldestCount() const
+    {
+        return droppedOldest;
+    }
+
+private:
+    // Returns false if async mode was switched off before the ring could be used
+    bool logAsync(LogLevel level, string_view message, initializer_list<LogField> fields)
+    {
+        activeProducers.fetch_add(1);
+        LogRingBuffer *ring = ringBuffer.load();
+        if (ring)
+        {
+            char bodyStorage[LogRecord::MAX_TEXT];
+            LogBuffer body(bodyStorage, sizeof(bodyStorage));
+            LogFormatter::appendBody(body, format, message, fields);
+            enqueue(*ring, body.view(), level, LogFormatter::nowMillis());
+        }
+        activeProducers.fetch_sub(1, memory_order_release);
+        return ring != nullptr;
+    }
+
+    void enqueue(LogRingBuffer &ring, string_view body, LogLevel level, long long epochMillis)
+    {
+        while (!ring.tryPush(level, epochMillis, body))
+        {
+            if (overflowPolicy == OverflowPolicy::DROP_NEWEST)
+            {
+                droppedNewest++;
+                return;
+            }
+            if (overflowPolicy == OverflowPolicy::DROP_OLDEST)
+            {
+                LogRecord discarded;
+                if (ring.tryPop(discarded))
+                    droppedOldest++;
+            }
+            else
+            {
+                this_thread::yield();
+            }
+        }
+        if (writerWaiting.load(memory_order_relaxed))
+        {
+            lock_guard<mutex> lock(writerMutex);
+            writerCV.notify_one();
+        }
     }
 
-    void log(string &message, LogLevel level)
+    void writerLoop(LogRingBuffer *ring)
     {
-        if (strategy)
+        // Records are popped in groups; each sink gets the ones passing its level
+        // filter formatted back to back into one buffer and written with a single call
+        const size_t maxLine = LogRecord::MAX_TEXT + 128;
+        vector<char> storage(1 << 16);
+        LogBuffer batch(storage.data(), storage.size());
+        vector<LogRecord> records(256);
+        while (true)
         {
-            string logMessage = "[" + getCurrentTimestamp() + "] [" + getLogLevelString(level) + "] " + message;
-            strategy->log(logMessage);
+            // Read the flag before popping, so the pass that sees it also drains
+            // everything pushed before disableAsync() set it
+            bool stopping = stopWriter;
+            size_t count = 0;
+            while (count < records.size() && ring->tryPop(records[count]))
+                count++;
+            if (count > 0)
+            {
+                auto snapshot = currentSinks();
+                for (const LogSink &sink : *snapshot)
+                {
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        const LogRecord &record = records[i];
+                        if (record.level < sink.minLevel)
+                            continue;
+                        if (batch.remaining() < maxLine)
+                        {
+                            sink.strategy->write(batch.view());
+                            batch.clear();
+                        }
+                        LogFormatter::appendLine(batch, format, record.level, record.epochMillis, string_view(record.text, record.length));
+                    }
+                    if (batch.size() > 0)
+                        sink.strategy->write(batch.view());
+                    batch.clear();
+                }
+                continue;
+            }
+            if (stopping)
+                return;
+            // Idle: sleep until a producer signals or a short timeout passes
+            unique_lock<mutex> lock(writerMutex);
+            writerWaiting = true;
+            writerCV.wait_for(lock, chrono::milliseconds(1));
+            writerWaiting = false;
         }
     }
 };
 
-Logger *Logger::instance = nullptr;
+// Arguments are only evaluated when the level is compiled in and enabled at runtime
+#define LOG_AT(level, ...)                                     \
+    do                                                         \
+    {                                                          \
+        if constexpr (isCompiledIn(level))                     \
+        {                                                      \
+            Logger *logger_ = Logger::getInstance();           \
+            if (logger_->isEnabled(level))                     \
+                logger_->logArgs(level, __VA_ARGS__);          \
+        }                                                      \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::ERROR, __VA_ARGS__)
+
+// Discards output so the benchmark measures formatting only
+class NullLogStrategy : public LogStrategy
+{
+public:
+    size_t bytes = 0;
+
+    void log(string &message) override
+    {
+        bytes += message.size();
+    }
+
+    void write(string_view lines) override
+    {
+        bytes += lines.size();
+    }
+};
+
+// ns/message of the previous Logger::log formatting (time/localtime/strftime and
+// string concatenation per call) versus the buffer-based formatter
+void benchmarkFormatting()
+{
+    const int messages = 1000000;
+    Logger *logger = Logger::getInstance();
+    NullLogStrategy sink;
+    string message = "request served";
+
+    auto measure = [&](auto &&logOne)
+    {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < messages; i++)
+            logOne(i);
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / messages;
+    };
+
+    double legacy = measure([&](int)
+                            {
+        std::time_t now = std::time(nullptr);
+        char buf[20];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+        string level = "INFO";
+        string logMessage = "[" + std::string(buf) + "] [" + level + "] " + message;
+        sink.log(logMessage); });
+
+    logger->setStrategy(&sink);
+    double text = measure([&](int)
+                          { logger->log(LogLevel::INFO, message); });
+    double fields = measure([&](int i)
+                            { logger->log(LogLevel::INFO, message, {{"requestId", i}, {"route", "/orders"}}); });
+    logger->setFormat(LogFormat::JSON);
+    double json = measure([&](int i)
+                          { logger->log(LogLevel::INFO, message, {{"requestId", i}, {"route", "/orders"}}); });
+    logger->setFormat(LogFormat::TEXT);
+    logger->setStrategy(nullptr);
+
+    cout << "previous Logger::log : " << legacy << " ns/msg" << endl;
+    cout << "text                 : " << text << " ns/msg" << endl;
+    cout << "text + 2 fields      : " << fields << " ns/msg" << endl;
+    cout << "json + 2 fields      : " << json << " ns/msg" << endl;
+}
+
+// 1M lines written the previous way (one flush per line), through the new
+// formatter without buffering, and through the buffered sink
+void benchmarkFileSink()
+{
+    const int lines = 1000000;
+    Logger *logger = Logger::getInstance();
+    auto writeLines = [&](const string &path, FileLogOptions options)
+    {
+        double ms;
+        {
+            FileLogStrategy sink(path, options);
+            logger->setStrategy(&sink);
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < lines; i++)
+                logger->log(LogLevel::INFO, "request served", {{"requestId", i}});
+            logger->setStrategy(nullptr);
+            sink.flush();
+            ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        }
+        remove(path.c_str());
+        return ms;
+    };
+
+    FileLogOptions perLine;
+    perLine.bufferBytes = 0;
+    perLine.fsyncPolicy = FsyncPolicy::NEVER;
+    FileLogOptions buffered;
+    buffered.fsyncPolicy = FsyncPolicy::NEVER;
+
+    // The previous path: string concatenation plus ofstream << endl per line
+    double previous;
+    {
+        ofstream file("bench_previous.log", ios::app);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < lines; i++)
+        {
+            std::time_t now = std::time(nullptr);
+            char buf[20];
+            std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+            string logMessage = "[" + std::string(buf) + "] [INFO] request served requestId=" + to_string(i);
+            file << logMessage << endl;
+        }
+        previous = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+    remove("bench_previous.log");
+
+    cout << "1M lines, previous Logger::log to file : " << previous << " ms" << endl;
+    cout << "1M lines, write-through sink           : " << writeLines("bench_unbuffered.log", perLine) << " ms" << endl;
+    cout << "1M lines, 1 MB buffered sink           : " << writeLines("bench_buffered.log", buffered) << " ms" << endl;
+}
 
 int main()
 {
@@ -143,6 +1131,87 @@ int main()
     logger->setStrategy(&fileStrategy);
     logger->log("Logging to file", LogLevel::ERROR);
 
+    // Time spent on the callers' threads for the same 4 x 50k messages, sync vs async
+    const int threads = 4;
+    const int messagesPerThread = 50000;
+    auto logFromThreads = [&]()
+    {
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([logger, t]()
+                                 {
+                string message = "request handled by worker " + to_string(t);
+                for (int i = 0; i < messagesPerThread; i++)
+                    logger->log(message, LogLevel::INFO); });
+        }
+        for (auto &worker : workers)
+            worker.join();
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    cout << "sync file logging : " << logFromThreads() << " ms" << endl;
+
+    logger->enableAsync(1 << 14, OverflowPolicy::BLOCK);
+    cout << "async (block)     : " << logFromThreads() << " ms" << endl;
+    logger->disableAsync();
+
+    logger->enableAsync(1 << 10, OverflowPolicy::DROP_NEWEST);
+    cout << "async (drop-new)  : " << logFromThreads() << " ms, dropped " << logger->getDroppedNewestCount() << endl;
+    logger->disableAsync();
+
+    // Fan-out: everything to the console, only errors to a rotating, gzipped file
+    {
+        FileLogOptions rotating;
+        rotating.bufferBytes = 4096;
+        rotating.maxFileBytes = 16 * 1024;
+        rotating.maxBackups = 2;
+        rotating.compressOnRotate = true;
+        FileLogStrategy errorFile("errors.log", rotating);
+        logger->setStrategy(&consoleStrategy);
+        logger->addSink(&errorFile, LogLevel::ERROR);
+        logger->log("only on the console", LogLevel::INFO);
+        logger->log("on the console and in errors.log", LogLevel::ERROR);
+        logger->removeSink(&consoleStrategy);
+        for (int i = 0; i < 2000; i++)
+            logger->log(LogLevel::ERROR, "disk quota exceeded", {{"volume", i % 4}});
+        logger->setStrategy(nullptr);
+        cout << "errors.log rotations: " << errorFile.getRotationCount() << endl;
+    }
+    for (const char *path : {"errors.log", "errors.log.1", "errors.log.2", "errors.log.1.gz", "errors.log.2.gz"})
+        remove(path);
+
+    // Structured fields, as text and as JSON lines
+    logger->setStrategy(&consoleStrategy);
+    logger->log(LogLevel::INFO, "order placed", {{"orderId", 1042}, {"user", "alice"}});
+    logger->setFormat(LogFormat::JSON);
+    logger->log(LogLevel::WARNING, "payment \"retry\"", {{"orderId", 1042}, {"attempt", 2}});
+    logger->setFormat(LogFormat::TEXT);
+
+    benchmarkFormatting();
+    benchmarkFileSink();
+
+    // Level threshold: disabled calls neither format nor evaluate their arguments
+    int evaluations = 0;
+    auto expensiveState = [&evaluations]()
+    {
+        evaluations++;
+        return string("cart with 3 items");
+    };
+    logger->setStrategy(&consoleStrategy);
+    logger->setMinLevel(LogLevel::INFO);
+    LOG_DEBUG("state dump: ", expensiveState());
+    LOG_INFO("user ", 42, " checked out in ", 12.5, " ms");
+    logger->logAt<LogLevel::WARNING>("inventory low for sku ", 1001);
+    cout << "debug argument evaluations: " << evaluations << endl;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < 10000000; i++)
+        LOG_DEBUG("state dump: ", expensiveState());
+    cout << "disabled LOG_DEBUG: " << chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / 10000000
+         << " ns/call" << endl;
+
     return 0;
 }
 
@@ -166,9 +1235,42 @@ making the system flexible and extensible.
 Design patterns are used:
 ------------------------
 Singleton Pattern: The Logger class is implemented as a singleton to ensure that only one instance of the logger
-exists throughout the application.
+exists throughout the application. getInstance() returns a function-local static, so initialisation is thread-safe
+without taking a lock on every call.
 
 Strategy Pattern: The logging mechanism uses the strategy pattern to allow the logging behavior to be defined at runtime.
 This is done through the LogStrategy interface and its concrete implementations (ConsoleLogStrategy and FileLogStrategy).
 The Logger class can switch between different logging strategies (e.g., console or file logging) dynamically using the setStrategy method.
+
+Async mode
+----------
+enableAsync() takes disk latency off the caller's thread. log() copies the message into a preallocated lock-free
+ring buffer (LogRingBuffer) and returns; a dedicated writer thread pops records, formats them and hands them to the
+strategy in batches through a single write() call, which flushes once per batch instead of once per line. When the
+buffer is full the OverflowPolicy decides whether callers block, the new message is dropped, or the oldest queued
+message is dropped; the drop counters are exposed through getDroppedNewestCount()/getDroppedOldestCount().
+
+Formatting
+----------
+LogFormatter writes lines into fixed buffers (LogBuffer) instead of concatenating std::strings: the calling thread
+renders the body (message plus structured LogFields) into a thread-local buffer, and the timestamp/level prefix is
+added when the line is written. The timestamp text is cached per thread and only re-rendered through localtime once a
+second; the milliseconds are patched in place. Level names are string_views, and LogFormat::JSON emits JSON lines.
+Strategies receive the finished bytes through write(string_view).
+
+Level filtering
+---------------
+LogLevel is ordered by severity. setMinLevel() sets a runtime threshold, and LOG_COMPILE_MIN_LEVEL sets a compile-time
+one: the LOG_DEBUG/LOG_INFO/... macros and logAt<level>() wrap the call in `if constexpr`, so levels below it generate
+no code. The macros also check the runtime threshold before evaluating their arguments, which are then concatenated
+into the thread-local buffer rather than into temporary strings.
+
+Sinks
+-----
+setStrategy() installs a single destination; addSink() adds more, each with its own minimum level, so a message is
+formatted once and fanned out to every sink that accepts it. The sink list is copy-on-write, so logging threads never
+lock it. FileLogStrategy buffers lines in user space (1 MB by default) and writes the buffer with one write() call
+when it fills or after flushInterval, rotates by size and/or age keeping maxBackups numbered files (optionally
+gzipped by a gzip process run from a background thread, without a shell; a backup that fails to compress stays
+plain), and calls fsync according to its FsyncPolicy.
 */
\ No newline at end of file
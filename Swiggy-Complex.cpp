@@ -30,11 +30,13 @@ enum class CUISINE
     ITALIAN,
 };
 
+// In the order an order goes through them; CANCELLED can follow any status before PICKED_UP
 enum class ORDER_STATUS
 {
     PLACED,
     ORDERED,
     ACCEPTED,
+    PICKED_UP,
     ON_THE_WAY,
     REACHED,
     DELIVERED,
@@ -63,14 +65,454 @@ public:
     }
     int getLatitude()
     {
-        return Latitude;
+        return latitude;
     }
 };
+// Hierarchical timing wheel: four levels of 256 slots over 1 ms ticks, so a timer up to
+// ~49 days out is placed in O(1) and each tick only visits the one slot falling due.
+// Far timers wait in a coarse slot and cascade down a level as the wheel reaches them.
+// Timers live in one pool linked by index, so a pending timer costs a pool entry and no
+// allocation beyond its callback. Not thread-safe: an EventLoop owns it.
+class TimerWheel
+{
+public:
+    struct TimerId
+    {
+        uint32_t index = UINT32_MAX, generation = 0;
+    };
+
+private:
+    static constexpr int LEVELS = 4, SLOT_BITS = 8, SLOTS = 1 << SLOT_BITS;
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr uint64_t MAX_DELAY = (1ull << (LEVELS * SLOT_BITS)) - 1;
+
+    struct Node
+    {
+        function<void()> callback;
+        uint64_t expiry;
+        uint32_t previous, next, generation = 0;
+        int slot = -1; // level * SLOTS + slot, -1 while in the free list
+    };
+    vector<Node> nodes;
+    uint32_t freeList = NONE;
+    vector<uint32_t> heads;
+    uint64_t now = 0;
+    size_t pending = 0;
+
+    // The level is the highest 8-bit digit where expiry and now differ; the slot is
+    // expiry's digit at that level, reached exactly when the lower digits roll to zero
+    int slotFor(uint64_t pExpiry) const
+    {
+        uint64_t differing = pExpiry ^ now;
+        int level = 0;
+        while (level < LEVELS - 1 && (differing >> (SLOT_BITS * (level + 1))) != 0)
+            level++;
+        return level * SLOTS + (int)((pExpiry >> (SLOT_BITS * level)) & (SLOTS - 1));
+    }
+
+    void link(uint32_t pIndex)
+    {
+        Node &node = nodes[pIndex];
+        node.slot = slotFor(node.expiry);
+        node.previous = NONE;
+        node.next = heads[node.slot];
+        if (node.next != NONE)
+            nodes[node.next].previous = pIndex;
+        heads[node.slot] = pIndex;
+    }
+
+    void unlink(uint32_t pIndex)
+    {
+        Node &node = nodes[pIndex];
+        if (node.previous != NONE)
+            nodes[node.previous].next = node.next;
+        else
+            heads[node.slot] = node.next;
+        if (node.next != NONE)
+            nodes[node.next].previous = node.previous;
+    }
+
+    void release(uint32_t pIndex)
+    {
+        Node &node = nodes[pIndex];
+        node.slot = -1;
+        node.generation++;
+        node.next = freeList;
+        freeList = pIndex;
+        pending--;
+    }
+
+    void cascade(int pSlot)
+    {
+        uint32_t index = heads[pSlot];
+        heads[pSlot] = NONE;
+        while (index != NONE)
+        {
+            uint32_t next = nodes[index].next;
+            link(index);
+            index = next;
+        }
+    }
+
+public:
+    TimerWheel() : heads(LEVELS * SLOTS, NONE)
+    {
+    }
+
+    uint64_t currentTick() const
+    {
+        return now;
+    }
+
+    size_t size() const
+    {
+        return pending;
+    }
+
+    // Runs pCallback on the first tick at least pDelayTicks (minimum 1) from now
+    TimerId schedule(uint64_t pDelayTicks, function<void()> pCallback)
+    {
+        uint32_t index = freeList;
+        if (index != NONE)
+            freeList = nodes[index].next;
+        else
+        {
+            index = (uint32_t)nodes.size();
+            nodes.emplace_back();
+        }
+        Node &node = nodes[index];
+        node.callback = move(pCallback);
+        node.expiry = now + min(MAX_DELAY, max<uint64_t>(1, pDelayTicks));
+        link(index);
+        pending++;
+        return {index, node.generation};
+    }
+
+    // False if the timer already fired or was cancelled
+    bool cancel(TimerId pId)
+    {
+        if (pId.index >= nodes.size() || nodes[pId.index].generation != pId.generation || nodes[pId.index].slot < 0)
+            return false;
+        unlink(pId.index);
+        nodes[pId.index].callback = nullptr;
+        release(pId.index);
+        return true;
+    }
+
+    // Moves one tick forward and runs the timers due on it; returns how many ran
+    size_t tick()
+    {
+        now++;
+        // Coarser slots that just came due spread over the finer levels, highest first
+        for (int level = LEVELS - 1; level > 0; level--)
+            if ((now & ((1ull << (SLOT_BITS * level)) - 1)) == 0)
+                cascade(level * SLOTS + (int)((now >> (SLOT_BITS * level)) & (SLOTS - 1)));
+        int slot = (int)(now & (SLOTS - 1));
+        size_t fired = 0;
+        // Popped one at a time: a callback may cancel a timer later in this same slot
+        while (heads[slot] != NONE)
+        {
+            uint32_t index = heads[slot];
+            unlink(index);
+            function<void()> callback = move(nodes[index].callback);
+            nodes[index].callback = nullptr;
+            release(index);
+            callback();
+            fired++;
+        }
+        return fired;
+    }
+
+    // Ticks up to pTick; with nothing pending the wheel just jumps there
+    size_t advanceTo(uint64_t pTick)
+    {
+        size_t fired = 0;
+        while (now < pTick)
+        {
+            if (pending == 0)
+            {
+                now = pTick;
+                break;
+            }
+            fired += tick();
+        }
+        return fired;
+    }
+};
+
+// One thread that owns a TimerWheel and runs its timers together with tasks posted from
+// other threads, so millions of entities can wait on timers without a thread each. State
+// touched only by the loop's tasks and timers needs no locking.
+class EventLoop
+{
+public:
+    struct Stats
+    {
+        uint64_t timersFired, busyMicros, latenessP50Ms, latenessP99Ms, latenessMaxMs;
+        size_t pendingTimers;
+    };
+
+private:
+    static constexpr int LATENESS_BUCKETS = 1024; // 1 ms each, the last one open ended
+
+    TimerWheel wheel;
+    const chrono::steady_clock::time_point epoch;
+    mutex postMutex;
+    condition_variable postCV;
+    vector<function<void()>> posted;
+    bool stopping = false, sleeping = false;
+    atomic<uint64_t> nowMs{0}, timersFired{0}, busyMicros{0};
+    atomic<size_t> pendingTimers{0};
+    vector<atomic<uint64_t>> lateness;
+    thread worker;
+
+    uint64_t elapsedMs() const
+    {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - epoch).count();
+    }
+
+    void runTimers()
+    {
+        uint64_t target = elapsedMs();
+        while (wheel.currentTick() < target)
+        {
+            if (wheel.size() == 0)
+            {
+                wheel.advanceTo(target);
+                break;
+            }
+            size_t fired = wheel.tick();
+            if (fired)
+            {
+                // How far real time had moved past the tick once its timers were done
+                uint64_t late = elapsedMs() - wheel.currentTick();
+                lateness[min<uint64_t>(late, LATENESS_BUCKETS - 1)].fetch_add(fired, memory_order_relaxed);
+                timersFired.fetch_add(fired, memory_order_relaxed);
+            }
+        }
+        nowMs.store(wheel.currentTick(), memory_order_relaxed);
+        pendingTimers.store(wheel.size(), memory_order_relaxed);
+    }
+
+    void run()
+    {
+        vector<function<void()>> tasks;
+        unique_lock<mutex> lock(postMutex);
+        while (!stopping)
+        {
+            if (posted.empty())
+            {
+                sleeping = true;
+                if (wheel.size() == 0)
+                    postCV.wait(lock, [this]()
+                                { return stopping || !posted.empty(); });
+                else
+                    postCV.wait_until(lock, epoch + chrono::milliseconds(wheel.currentTick() + 1), [this]()
+                                      { return stopping || !posted.empty(); });
+                sleeping = false;
+            }
+            swap(tasks, posted);
+            lock.unlock();
+            auto start = chrono::steady_clock::now();
+            for (auto &task : tasks)
+                task();
+            tasks.clear();
+            runTimers();
+            busyMicros.fetch_add(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count(),
+                                 memory_order_relaxed);
+            lock.lock();
+        }
+    }
+
+public:
+    EventLoop() : epoch(chrono::steady_clock::now()), lateness(LATENESS_BUCKETS)
+    {
+        worker = thread([this]()
+                        { run(); });
+    }
+
+    ~EventLoop()
+    {
+        {
+            lock_guard<mutex> lock(postMutex);
+            stopping = true;
+        }
+        postCV.notify_one();
+        worker.join();
+    }
+
+    static EventLoop *getEventLoop()
+    {
+        static EventLoop instance;
+        return &instance;
+    }
+
+    bool inLoopThread() const
+    {
+        return this_thread::get_id() == worker.get_id();
+    }
+
+    // Loop time in ms: the last tick the timers have been run up to
+    uint64_t now() const
+    {
+        return nowMs.load(memory_order_relaxed);
+    }
+
+    // Runs pTask on the loop thread, from any thread
+    void post(function<void()> pTask)
+    {
+        bool wake;
+        {
+            lock_guard<mutex> lock(postMutex);
+            posted.push_back(move(pTask));
+            wake = sleeping && posted.size() == 1;
+        }
+        if (wake)
+            postCV.notify_one();
+    }
+
+    // Loop thread only; other threads post a task that schedules
+    TimerWheel::TimerId schedule(chrono::milliseconds pDelay, function<void()> pCallback)
+    {
+        // Counted from real time, which the wheel lags while a burst of tasks runs, and
+        // rounded up a tick, so a timer never fires early
+        uint64_t behind = elapsedMs() - wheel.currentTick();
+        return wheel.schedule(behind + max<int64_t>(0, pDelay.count()) + 1, move(pCallback));
+    }
+
+    bool cancel(TimerWheel::TimerId pId)
+    {
+        return wheel.cancel(pId);
+    }
+
+    Stats stats() const
+    {
+        uint64_t total = 0, seen = 0, p50 = 0, p99 = 0, maxLate = 0;
+        for (int bucket = 0; bucket < LATENESS_BUCKETS; bucket++)
+            total += lateness[bucket].load(memory_order_relaxed);
+        for (int bucket = 0; bucket < LATENESS_BUCKETS; bucket++)
+        {
+            uint64_t count = lateness[bucket].load(memory_order_relaxed);
+            if (!count)
+                continue;
+            if (seen < total / 2 && seen + count >= total / 2)
+                p50 = bucket;
+            if (seen < total * 99 / 100 && seen + count >= total * 99 / 100)
+                p99 = bucket;
+            seen += count;
+            maxLate = bucket;
+        }
+        return {timersFired.load(memory_order_relaxed), busyMicros.load(memory_order_relaxed), p50, p99, maxLate,
+                pendingTimers.load(memory_order_relaxed)};
+    }
+};
+
+// Append-only history of status changes shared by many entities. An entity keeps only the
+// index of its latest event and each event links to the one before it, so the entity's
+// status is its latest event and its history a walk back from there. A transition is a
+// compare-and-swap of that index: racing transitions of one entity are serialised, and
+// recorded in the order they took effect. Events sit in fixed chunks and never move or
+// change once published.
+template <typename Status>
+class EventLog
+{
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    struct Event
+    {
+        uint32_t atMs;     // since the log was created
+        uint32_t previous; // NONE for an entity's first event
+        Status status;
+    };
+
+private:
+    static constexpr uint32_t CHUNK_BITS = 16, CHUNK_SIZE = 1u << CHUNK_BITS, MAX_CHUNKS = 1u << 16;
+
+    unique_ptr<atomic<Event *>[]> chunks;
+    atomic<uint32_t> nextSlot{0};
+    const chrono::steady_clock::time_point epoch;
+
+    Event &at(uint32_t pSlot) const
+    {
+        return chunks[pSlot >> CHUNK_BITS].load(memory_order_acquire)[pSlot & (CHUNK_SIZE - 1)];
+    }
+
+    uint32_t allocate()
+    {
+        uint32_t slot = nextSlot.fetch_add(1, memory_order_relaxed);
+        atomic<Event *> &chunk = chunks[slot >> CHUNK_BITS];
+        if (!chunk.load(memory_order_acquire))
+        {
+            Event *fresh = new Event[CHUNK_SIZE];
+            Event *expected = nullptr;
+            if (!chunk.compare_exchange_strong(expected, fresh, memory_order_acq_rel))
+                delete[] fresh;
+        }
+        return slot;
+    }
+
+public:
+    EventLog() : chunks(new atomic<Event *>[MAX_CHUNKS]()), epoch(chrono::steady_clock::now())
+    {
+    }
+
+    ~EventLog()
+    {
+        for (uint32_t chunk = 0; chunk < MAX_CHUNKS; chunk++)
+            delete[] chunks[chunk].load();
+    }
+
+    // Appends pTo to the entity whose latest event index is pHead, provided it has no
+    // events yet or pAllowed(current status, pTo) holds
+    template <typename Allowed>
+    bool append(atomic<uint32_t> &pHead, Status pTo, Allowed pAllowed)
+    {
+        uint32_t head = pHead.load(memory_order_acquire), slot = NONE;
+        while (head == NONE || pAllowed(at(head).status, pTo))
+        {
+            if (slot == NONE)
+                slot = allocate(); // left unused if the transition is then refused
+            at(slot) = {(uint32_t)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - epoch).count(), head, pTo};
+            if (pHead.compare_exchange_weak(head, slot, memory_order_release, memory_order_acquire))
+                return true;
+        }
+        return false;
+    }
+
+    void append(atomic<uint32_t> &pHead, Status pTo)
+    {
+        append(pHead, pTo, [](Status, Status)
+               { return true; });
+    }
+
+    // The entity must have at least one event
+    Status current(const atomic<uint32_t> &pHead) const
+    {
+        return at(pHead.load(memory_order_acquire)).status;
+    }
+
+    // Oldest first
+    vector<Event> history(const atomic<uint32_t> &pHead) const
+    {
+        vector<Event> events;
+        for (uint32_t slot = pHead.load(memory_order_acquire); slot != NONE; slot = at(slot).previous)
+            events.push_back(at(slot));
+        reverse(events.begin(), events.end());
+        return events;
+    }
+
+    size_t size() const
+    {
+        return nextSlot.load(memory_order_relaxed);
+    }
+};
+
 // Observer Pattern - NotificationMgr = subject
 class INotificationSender
 {
 public:
     virtual void sendNotification(string userId, string msg) = 0;
+    virtual ~INotificationSender() {}
 };
 
 class SMSNotificationSender : public INotificationSender
@@ -91,6 +533,7 @@ public:
     }
 };
 
+// Used from the event loop thread, which runs every order's steps
 class NotificationMgr
 {
     NotificationMgr()
@@ -115,7 +558,7 @@ public:
     // Subscribe observer
     void addNotificationSender(string pOrderId, string pUserId, INotificationSender *pNotificationSender)
     {
-        if (find(notificationSendersMap[pOrderId].begin(), notificationSendersMap[pOrderId].end(), {pUserId, pNotificationSender}) == notificationSendersMap[pOrderId].end())
+        if (find(notificationSendersMap[pOrderId].begin(), notificationSendersMap[pOrderId].end(), make_pair(pUserId, pNotificationSender)) == notificationSendersMap[pOrderId].end())
         {
             // making sure the sender is already not there in the vector  to avoid sending multiple notifications
             notificationSendersMap[pOrderId].push_back({pUserId, pNotificationSender});
@@ -124,15 +567,30 @@ public:
     // Unsubscribe observer
     void removeNotificationSender(string pOrderId, string pUserId, INotificationSender *pNotificationSender)
     {
-        auto senderPos = find(notificationSendersMap[pOrderId].begin(), notificationSendersMap[pOrderId].end(), {pUserId, pNotificationSender});
+        auto senderPos = find(notificationSendersMap[pOrderId].begin(), notificationSendersMap[pOrderId].end(), make_pair(pUserId, pNotificationSender));
         if (senderPos != notificationSendersMap[pOrderId].end())
             notificationSendersMap[pOrderId].erase(senderPos);
     }
 
+    // Unsubscribe every observer of a delivered or cancelled order; its senders were
+    // created for that order alone, so they are freed here too
+    void removeOrderNotificationSenders(string orderId)
+    {
+        auto senders = notificationSendersMap.find(orderId);
+        if (senders == notificationSendersMap.end())
+            return;
+        for (auto &it : senders->second)
+            delete it.second;
+        notificationSendersMap.erase(senders);
+    }
+
     // notify subscribers
     void notify(string orderId, string pMsg)
     {
-        for (auto it : notificationSendersMap[orderId])
+        auto senders = notificationSendersMap.find(orderId);
+        if (senders == notificationSendersMap.end())
+            return;
+        for (auto &it : senders->second)
             it.second->sendNotification(it.first, pMsg);
     }
 
@@ -142,10 +600,15 @@ public:
         sender->sendNotification(userId, pMsg);
     }
 };
+NotificationMgr *NotificationMgr::notificationMgrInstance = nullptr;
+mutex NotificationMgr::mtx;
+
 // Interface
 class IPartner
 {
-    Rating rating;
+    RATING rating;
+
+protected:
     string name;
 
 public:
@@ -160,71 +623,6 @@ public:
     // void performKYC() = 0;
 };
 
-class DeliveryPartner : public IPartner
-{
-public:
-    DeliveryPartner(string pName) : IPartner(pName) {}
-    // Order Status also needs to be updated while these steps are happening
-    // We have black-boxed that
-    void performDelivery(string pOrderId, DeliveryMetaData *pDeliveryMetaData)
-    {
-        NotificationMgr *notificationMgr = NotificationMgr::getNotificationMgr();
-
-        double restaurantLocLatitude = pDeliveryMetaData->getRestaurantLoc()->getLatitude();
-        double restaurantLocLongitude = pDeliveryMetaData->getRestaurantLoc()->getLongitude();
-        notificationMgr->notify(pOrderId, name + " going to pick up delivery from location " + to_string(restaurantLocLatitude) + "," + to_string(restaurantLocLongitude));
-
-        this_thread::sleep_for(chrono::seconds(5));
-
-        notificationMgr->notify(pOrderId, name + " picked up delivery!");
-
-        this_thread::sleep_for(chrono::seconds(5));
-
-        notificationMgr->notify(pOrderId, name + " on the way to deliver!");
-
-        this_thread::sleep_for(chrono::seconds(5));
-
-        double userLocLatitude = pDeliveryMetaData->getUserLoc()->getLatitude();
-        double userLocLongitude = pDeliveryMetaData->getUserLoc()->getLongitude();
-        notificationMgr->notify(pOrderId, name + " reached the location " + to_string(userLocLatitude) + "," + to_string(userLocLongitude));
-
-        this_thread::sleep_for(chrono::seconds(5));
-
-        notificationMgr->notify(pOrderId, name + " delivered the order. CONGRATULATIONS!!");
-    }
-};
-class DeliveryPartnerMgr
-{
-    unordered_map<string, DeliveryPartner *> deliveryPartnerMap;
-    static DeliveryPartnerMgr *deliveryPartnerMgrInstance = nullptr;
-    static mutex mtx;
-    DeliveryPartnerMgr() {}
-
-public:
-    static DeliveryPartnerMgr *getDeliveryPartnerMgr()
-    {
-        if (deliveryPartnerMgrInstance == nullptr)
-        {
-            mtx.lock();
-            if (deliveryPartnerMgrInstance == nullptr)
-                deliveryPartnerMgrInstance = new DeliveryPartnerMgr();
-            mtx.unlock();
-        }
-        return deliveryPartnerMgrInstance;
-    }
-    void addDeliveryPartner(string partnerName, DeliveryPartner *partner)
-    {
-        deliveryPartnerMap[partnerName] = partner;
-    }
-    DeliveryPartner *getDeliveryPartner(string partnerName)
-    {
-        return deliveryPartnerMap[partnerName];
-    }
-    unordered_map<string, DeliveryPartner *> getDeliveryPartnerMap()
-    {
-        return deliveryPartnerMap;
-    }
-};
 class RestaurantPartner : public IPartner
 {
 public:
@@ -286,46 +684,16 @@ public:
     Menu(vector<Dish *> pDishes) : dishes(pDishes) {}
 };
 
-class FoodMgr
-{
-    static FoodMgr *foodMgrInstance = nullptr;
-    static mutex mtx;
-    FoodMgr() {}
-
-public:
-    static FoodMgr *getFoodMgr()
-    {
-        if (foodMgrInstance == nullptr)
-        {
-            mtx.lock();
-            if (foodMgrInstance == nullptr)
-                foodMgrInstance = new FoodMgr();
-        }
-        return foodMgrInstance;
-    }
-    void prepareFood(string orderId, string restaurantId, unordered_map<Dish *, int> pDishes)
-    {
-        RestaurantMgr *restaurantMgr = RestaurantMgr::getRestaurantMgr();
-        Restaurant *restaurant = restaurantMgr->getRestaurant(RestaurantId);
-        restaurant->prepareFood(orderId, pDishes);
-
-        addRestaurantForNotificationUpdates(orderId, restaurantId);
-    }
-    void addRestaurantForNotificationUpdates(string orderId, string restaurantId)
-    {
-        NotificationMgr *notificationMgr = NotificationMgr::getNotificationMgr();
-        notificationMgr->addNotificationSender(orderId, restaurantId, new PushNotificationSender());
-    }
-};
 class Restaurant
 {
     string name;
     bool isAvailable;
     Location *loc;
-    Menu *menul RestaurantPartner *owner;
+    Menu *menu;
+    RestaurantPartner *owner;
 
 public:
-    Restaurant(string pName, RestaurantPartner *pOwner, Location *pLoc) : name(pName), owner(pOwner), loc(pLoc)
+    Restaurant(string pName, RestaurantPartner *pOwner, Location *pLoc) : name(pName), loc(pLoc), owner(pOwner)
     {
         isAvailable = false;
         menu = nullptr;
@@ -342,10 +710,10 @@ public:
     {
         return loc;
     }
-    bool prepareFood(string orderId, unordered_map < Dish *, int quantity)
+    bool prepareFood(string orderId, const unordered_map<Dish *, int> &)
     {
         cout << " Restaurant acdepted the order. Your food is being prepared." << endl;
-        NotificationMgr *notificationMggr = NotificationMgr::getNotificationMgr();
+        NotificationMgr *notificationMgr = NotificationMgr::getNotificationMgr();
         notificationMgr->notify(orderId, "Food id being prepared.");
         notificationMgr->notify(orderId, "Food id ready and ready for pickup.");
         return true;
@@ -355,7 +723,7 @@ public:
 class RestaurantMgr
 {
     unordered_map<string, Restaurant *> restaurantMap;
-    static RestaurantMgr *restaurantMgrInstance = nullptr;
+    static RestaurantMgr *restaurantMgrInstance;
     static mutex mtx;
     RestaurantMgr() {}
 
@@ -380,6 +748,43 @@ public:
         return restaurantMap[restaurantName];
     }
 };
+RestaurantMgr *RestaurantMgr::restaurantMgrInstance = nullptr;
+mutex RestaurantMgr::mtx;
+
+class FoodMgr
+{
+    static FoodMgr *foodMgrInstance;
+    static mutex mtx;
+    FoodMgr() {}
+
+public:
+    static FoodMgr *getFoodMgr()
+    {
+        if (foodMgrInstance == nullptr)
+        {
+            mtx.lock();
+            if (foodMgrInstance == nullptr)
+                foodMgrInstance = new FoodMgr();
+            mtx.unlock();
+        }
+        return foodMgrInstance;
+    }
+    void prepareFood(string orderId, string restaurantId, const unordered_map<Dish *, int> &pDishes)
+    {
+        RestaurantMgr *restaurantMgr = RestaurantMgr::getRestaurantMgr();
+        Restaurant *restaurant = restaurantMgr->getRestaurant(restaurantId);
+        restaurant->prepareFood(orderId, pDishes);
+
+        addRestaurantForNotificationUpdates(orderId, restaurantId);
+    }
+    void addRestaurantForNotificationUpdates(string orderId, string restaurantId)
+    {
+        NotificationMgr *notificationMgr = NotificationMgr::getNotificationMgr();
+        notificationMgr->addNotificationSender(orderId, restaurantId, new PushNotificationSender());
+    }
+};
+FoodMgr *FoodMgr::foodMgrInstance = nullptr;
+mutex FoodMgr::mtx;
 
 class User
 {
@@ -400,19 +805,20 @@ public:
 
 class UserMgr
 {
-    static UserMgr *userMgrInstance = nullptr;
+    static UserMgr *userMgrInstance;
     static mutex mtx;
     unordered_map<string, User *> userMap;
     UserMgr() {}
 
 public:
-    UserMgr *getUserMgr()
+    static UserMgr *getUserMgr()
     {
         if (userMgrInstance == nullptr)
         {
             mtx.lock();
             if (userMgrInstance == nullptr)
                 userMgrInstance = new UserMgr();
+            mtx.unlock();
         }
         return userMgrInstance;
     }
@@ -426,6 +832,8 @@ public:
         userMap[name] = user;
     }
 };
+UserMgr *UserMgr::userMgrInstance = nullptr;
+mutex UserMgr::mtx;
 
 class DeliveryMetaData
 {
@@ -447,6 +855,172 @@ public:
     }
 };
 
+class Order
+{
+    User *user;
+    Restaurant *restaurant;
+    unordered_map<Dish *, int> dishes;
+    string discountCode;
+    string paymentId;
+    atomic<uint32_t> lastEvent{EventLog<ORDER_STATUS>::NONE};
+    // generate orderId
+    string orderId;
+    static EventLog<ORDER_STATUS> orderEvents;
+
+    static bool isAllowed(ORDER_STATUS pFrom, ORDER_STATUS pTo)
+    {
+        if (pFrom == ORDER_STATUS::DELIVERED || pFrom == ORDER_STATUS::CANCELLED)
+            return false;
+        if (pTo == ORDER_STATUS::CANCELLED)
+            return pFrom < ORDER_STATUS::PICKED_UP;
+        return pTo > pFrom;
+    }
+
+public:
+    Order(User *pUser, Restaurant *pRestaurant, unordered_map<Dish *, int> pDishes) : user(pUser), restaurant(pRestaurant), dishes(pDishes)
+    {
+        orderEvents.append(lastEvent, ORDER_STATUS::PLACED);
+    }
+
+    string getUserName()
+    {
+        return user->getName();
+    }
+    string getRestaurantName()
+    {
+        return restaurant->getName();
+    }
+    string getOrderId()
+    {
+        return orderId;
+    }
+    const unordered_map<Dish *, int> &getDishes() { return dishes; }
+    Location *getUserLocation()
+    {
+        return user->getLocation();
+    }
+
+    Location *getRestaurantLocation()
+    {
+        return restaurant->getLocation();
+    }
+
+    // The status is whatever the order's latest event says; safe to read from any thread
+    ORDER_STATUS getStatus()
+    {
+        return orderEvents.current(lastEvent);
+    }
+    vector<EventLog<ORDER_STATUS>::Event> getHistory()
+    {
+        return orderEvents.history(lastEvent);
+    }
+
+    // False if pTo does not follow from the current status, e.g. after a cancellation
+    bool moveTo(ORDER_STATUS pTo)
+    {
+        return orderEvents.append(lastEvent, pTo, isAllowed);
+    }
+
+    static string statusToString(ORDER_STATUS pStatus)
+    {
+        static const string names[] = {"Placed", "Ordered", "Accepted", "Picked up", "On the way", "Reached", "Delivered", "Cancelled"};
+        return names[(int)pStatus];
+    }
+};
+EventLog<ORDER_STATUS> Order::orderEvents;
+
+class DeliveryPartner : public IPartner
+{
+    static constexpr chrono::seconds STEP_TIME{5};
+
+    // Each step comes STEP_TIME after the one before, as a timer on the event loop rather
+    // than a thread sleeping through the whole delivery
+    void scheduleStep(string pOrderId, Order *pOrder, DeliveryMetaData *pDeliveryMetaData, ORDER_STATUS pStep)
+    {
+        EventLoop::getEventLoop()->schedule(STEP_TIME, [this, pOrderId, pOrder, pDeliveryMetaData, pStep]()
+                                            { performStep(pOrderId, pOrder, pDeliveryMetaData, pStep); });
+    }
+
+    void performStep(string pOrderId, Order *pOrder, DeliveryMetaData *pDeliveryMetaData, ORDER_STATUS pStep)
+    {
+        // Cancellations also run on the loop, so a cancelled order stays cancelled from here on
+        if (pOrder->getStatus() == ORDER_STATUS::CANCELLED)
+            return;
+        NotificationMgr *notificationMgr = NotificationMgr::getNotificationMgr();
+        if (pStep == ORDER_STATUS::PICKED_UP)
+        {
+            notificationMgr->notify(pOrderId, name + " picked up delivery!");
+            scheduleStep(pOrderId, pOrder, pDeliveryMetaData, ORDER_STATUS::ON_THE_WAY);
+        }
+        else if (pStep == ORDER_STATUS::ON_THE_WAY)
+        {
+            notificationMgr->notify(pOrderId, name + " on the way to deliver!");
+            scheduleStep(pOrderId, pOrder, pDeliveryMetaData, ORDER_STATUS::REACHED);
+        }
+        else if (pStep == ORDER_STATUS::REACHED)
+        {
+            double userLocLatitude = pDeliveryMetaData->getUserLocation()->getLatitude();
+            double userLocLongitude = pDeliveryMetaData->getUserLocation()->getLongitude();
+            notificationMgr->notify(pOrderId, name + " reached the location " + to_string(userLocLatitude) + "," + to_string(userLocLongitude));
+            scheduleStep(pOrderId, pOrder, pDeliveryMetaData, ORDER_STATUS::DELIVERED);
+        }
+        else
+            notificationMgr->notify(pOrderId, name + " delivered the order. CONGRATULATIONS!!");
+        // Recorded once the step's notifications are out, so whoever sees the status sees them sent
+        pOrder->moveTo(pStep);
+        if (pStep == ORDER_STATUS::DELIVERED)
+            notificationMgr->removeOrderNotificationSenders(pOrderId);
+    }
+
+public:
+    DeliveryPartner(string pName) : IPartner(pName) {}
+    // Returns straight away, the rest of the delivery runs on the event loop
+    void performDelivery(string pOrderId, Order *pOrder, DeliveryMetaData *pDeliveryMetaData)
+    {
+        NotificationMgr *notificationMgr = NotificationMgr::getNotificationMgr();
+
+        double restaurantLocLatitude = pDeliveryMetaData->getRestaurantLocation()->getLatitude();
+        double restaurantLocLongitude = pDeliveryMetaData->getRestaurantLocation()->getLongitude();
+        notificationMgr->notify(pOrderId, name + " going to pick up delivery from location " + to_string(restaurantLocLatitude) + "," + to_string(restaurantLocLongitude));
+
+        scheduleStep(pOrderId, pOrder, pDeliveryMetaData, ORDER_STATUS::PICKED_UP);
+    }
+};
+class DeliveryPartnerMgr
+{
+    unordered_map<string, DeliveryPartner *> deliveryPartnerMap;
+    static DeliveryPartnerMgr *deliveryPartnerMgrInstance;
+    static mutex mtx;
+    DeliveryPartnerMgr() {}
+
+public:
+    static DeliveryPartnerMgr *getDeliveryPartnerMgr()
+    {
+        if (deliveryPartnerMgrInstance == nullptr)
+        {
+            mtx.lock();
+            if (deliveryPartnerMgrInstance == nullptr)
+                deliveryPartnerMgrInstance = new DeliveryPartnerMgr();
+            mtx.unlock();
+        }
+        return deliveryPartnerMgrInstance;
+    }
+    void addDeliveryPartner(string partnerName, DeliveryPartner *partner)
+    {
+        deliveryPartnerMap[partnerName] = partner;
+    }
+    DeliveryPartner *getDeliveryPartner(string partnerName)
+    {
+        return deliveryPartnerMap[partnerName];
+    }
+    unordered_map<string, DeliveryPartner *> getDeliveryPartnerMap()
+    {
+        return deliveryPartnerMap;
+    }
+};
+DeliveryPartnerMgr *DeliveryPartnerMgr::deliveryPartnerMgrInstance = nullptr;
+mutex DeliveryPartnerMgr::mtx;
+
 class DeliveryChargeCalculationStrategy
 {
 public:
@@ -486,111 +1060,79 @@ public:
 };
 class StrategyMgr
 {
-    static StrategyMgr *strategyMgrInstance = nullptr;
+    static StrategyMgr *strategyMgrInstance;
     static mutex mtx;
     StrategyMgr() {}
 
 public:
-    StrategyMgr *getStrategyMgrInstance()
+    static StrategyMgr *getStrategyMgrInstance()
     {
         if (strategyMgrInstance == nullptr)
         {
             mtx.lock();
             if (strategyMgrInstance == nullptr)
                 strategyMgrInstance = new StrategyMgr();
+            mtx.unlock();
         }
         return strategyMgrInstance;
     }
     IDeliveryPartnerMatchingStrategy *determineDeliveryPartnerMatchingStrategy(DeliveryMetaData *metaData)
     {
-        cout < " Based on Location, setting partner strategy " << endl;
+        cout << " Based on Location, setting partner strategy " << endl;
         return new LocationBasedDeliveryPartnerMatchingStrategy();
     }
 };
+StrategyMgr *StrategyMgr::strategyMgrInstance = nullptr;
+mutex StrategyMgr::mtx;
+
 class DeliveryMgr
 {
-    static DeliveryMgr *deliveryMgrInstance = nullptr;
+    static DeliveryMgr *deliveryMgrInstance;
     static mutex mtx;
     unordered_map<string, Restaurant *> restaurantMap;
     DeliveryMgr() {}
 
 public:
-    DeliveryMgr *getDeliveryMgrInstance()
+    static DeliveryMgr *getDeliveryMgr()
     {
         if (deliveryMgrInstance == nullptr)
         {
             mtx.lock();
             if (deliveryMgrInstance == nullptr)
                 deliveryMgrInstance = new DeliveryMgr();
+            mtx.unlock();
         }
         return deliveryMgrInstance;
     }
-    void manageDelivery(string pOrderId, DeliveryMetaData *data)
+    void manageDelivery(string pOrderId, Order *pOrder, DeliveryMetaData *data)
     {
         StrategyMgr *strategyMgr = StrategyMgr::getStrategyMgrInstance();
 
         IDeliveryPartnerMatchingStrategy *partnerMatchingStrategy = strategyMgr->determineDeliveryPartnerMatchingStrategy(data);
 
-        vector<DeliveryPartner *> deliveryPartners = partnerMatchingStrategy->matchDeliveryPartner(data);
+        vector<DeliveryPartner *> deliveryPartners = partnerMatchingStrategy->matchDeliveryPartners(data);
         NotificationMgr *notificationMgr = NotificationMgr::getNotificationMgr();
 
+        PushNotificationSender pushNotificationSender;
         for (auto partner : deliveryPartners)
         {
-            notificationMgr->notifyOneUser(partner->getName(), "Delivery Requested", new PushNotificationSender());
+            notificationMgr->notifyOneUser(partner->getName(), "Delivery Requested", &pushNotificationSender);
         }
 
-        DeliveryPartner *assignedDeliveryPartner = deliverypartners[0];
+        DeliveryPartner *assignedDeliveryPartner = deliveryPartners[0];
         notificationMgr->notify(pOrderId, "Delivery Partner " + assignedDeliveryPartner->getName() + " assigned  for Order " + pOrderId);
 
-        assignedDeliveryPartner->performDelivery(pOrderId, data);
-    }
-};
-
-class Order
-{
-    User *user;
-    Restaurant *restaurant;
-    unordered_map<Dish *, int> dishes;
-    string discountCode;
-    string paymentId;
-    ORDER_STATUS status;
-    // generate orderId
-    string orderId;
-
-public:
-    Order(User *pUser, Restaurant *pRestaurant, unordered_map<Dish *, int> pDishes) : user(pUser), restaurant(pRestaurant), dishes(pDishes)()
-    {
-        status = ORDER_STATUS ::PLACED;
-    }
-
-    string getUserName()
-    {
-        return user->getName();
-    }
-    string getRestaurantName()
-    {
-        return restaurant->getName();
-    }
-    string getOrderId()
-    {
-        return orderId;
-    }
-    unordered_map<Dish *, int> getDishes() { return dishes; }
-    Location *getUserLocation()
-    {
-        return user->getLocation();
-    }
-
-    Location *getRestaurantLocation()
-    {
-        return restaurant->getLocation();
+        assignedDeliveryPartner->performDelivery(pOrderId, pOrder, data);
     }
 };
+DeliveryMgr *DeliveryMgr::deliveryMgrInstance = nullptr;
+mutex DeliveryMgr::mtx;
 
 class OrderMgr
 {
-    static OrderMgr *orderMgrInstance = nullptr;
+    static OrderMgr *orderMgrInstance;
     static mutex mtx;
+    mutex orderMapMtx;
     unordered_map<string, Order *> orderMap;
     DeliveryMgr *deliveryMgr;
     FoodMgr *foodMgr;
@@ -610,16 +1152,17 @@ class OrderMgr
     void manageDelivery(string orderId, Order *pOrder)
     {
         DeliveryMetaData *data = new DeliveryMetaData(orderId, pOrder->getUserLocation(), pOrder->getRestaurantLocation());
-        deliveryMgr->manageDelivery(orderId, data);
+        deliveryMgr->manageDelivery(orderId, pOrder, data);
     }
 
     void manageFood(string orderId, Order *pOrder)
     {
-        foodMgr->prepareFood(orderId, pOrder->getRestaurantName(), pOrder->getDishes);
+        foodMgr->prepareFood(orderId, pOrder->getRestaurantName(), pOrder->getDishes());
+        pOrder->moveTo(ORDER_STATUS::ACCEPTED);
     }
 
 public:
-    OrderMgr *getOrderMgr()
+    static OrderMgr *getOrderMgr()
     {
         if (orderMgrInstance == nullptr)
         {
@@ -630,24 +1173,52 @@ public:
         }
         return orderMgrInstance;
     }
+    // Returns straight away: the order's steps run on the event loop, the one thread that
+    // touches notifications and moves orders along
     void createOrder(string orderId, Order *pOrder)
     {
-        addUserForNotificationUpdates(pOrderId, pOrder);
+        {
+            lock_guard<mutex> lock(orderMapMtx);
+            orderMap[orderId] = pOrder;
+        }
+        EventLoop::getEventLoop()->post([this, orderId, pOrder]()
+                                        {
+            addUserForNotificationUpdates(orderId, pOrder);
 
-        manageFood(pOrderId, pOrder);
+            manageFood(orderId, pOrder);
 
-        manageDelivery(pOrderId, pOrder);
+            manageDelivery(orderId, pOrder); });
+    }
+    // Refused once the order has been picked up; its pending delivery steps then do nothing
+    void cancelOrder(string orderId)
+    {
+        Order *order = getOrder(orderId);
+        if (!order)
+            return;
+        EventLoop::getEventLoop()->post([orderId, order]()
+                                        {
+            if (order->moveTo(ORDER_STATUS::CANCELLED))
+            {
+                NotificationMgr::getNotificationMgr()->notify(orderId, "Order cancelled");
+                NotificationMgr::getNotificationMgr()->removeOrderNotificationSenders(orderId);
+            }
+            else
+                NotificationMgr::getNotificationMgr()->notify(orderId, "Order can no longer be cancelled"); });
     }
     Order *getOrder(string orderId)
     {
-        return orderMap[orderId];
+        lock_guard<mutex> lock(orderMapMtx);
+        auto order = orderMap.find(orderId);
+        return order == orderMap.end() ? nullptr : order->second;
     }
 };
+OrderMgr *OrderMgr::orderMgrInstance = nullptr;
+mutex OrderMgr::mtx;
 
 int main()
 {
     // Chinese Restaurant
-    RestaurantPartner *owner1 = new RestaurantOwner("owner1");
+    RestaurantPartner *owner1 = new RestaurantPartner("owner1");
     Restaurant *chineseRest = new Restaurant("Hadako", owner1, new Location(1, 2));
     Dish *noodles = new Dish("noodles", CUISINE::CHINESE, 200);
     noodles->addAddOn({new DishAddOn("premium sauce", 20)});
@@ -685,5 +1256,21 @@ int main()
     OrderMgr *orderMgr = OrderMgr::getOrderMgr();
     orderMgr->createOrder("order1", order1);
 
+    // Suku cancels before the food is picked up; the partner's remaining steps are dropped
+    Order *order2 = new Order(user2, chineseRest, {{spring_rolls, 1}});
+    orderMgr->createOrder("order2", order2);
+    this_thread::sleep_for(chrono::seconds(2));
+    orderMgr->cancelOrder("order2");
+
+    // createOrder no longer blocks for the whole delivery, so wait for it here
+    while (order1->getStatus() != ORDER_STATUS::DELIVERED)
+        this_thread::sleep_for(chrono::milliseconds(100));
+    for (auto order : {make_pair("order1", order1), make_pair("order2", order2)})
+    {
+        cout << "History of " << order.first << ":" << endl;
+        for (auto event : order.second->getHistory())
+            cout << "  " << event.atMs << " ms  " << Order::statusToString(event.status) << endl;
+    }
+
     return 0;
-}
\ No newline at end of file
+}